@@ -0,0 +1,93 @@
+#ifndef INT_STACK_H
+#define INT_STACK_H
+
+// interface shared by the int_stack module and its userspace tools
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+// IOCTL commands
+#define INT_STACK_MAGIC 'S'
+// fails with EINVAL for 0 and for sizes whose bytes, rounded down to
+// whole pages, do not fit in 32 bits
+#define INT_STACK_SET_SIZE _IOW(INT_STACK_MAGIC, 1, unsigned int)
+#define INT_STACK_PEEK _IOWR(INT_STACK_MAGIC, 2, struct int_stack_peek)
+#define INT_STACK_GET_STATS _IOR(INT_STACK_MAGIC, 3, struct int_stack_ctl)
+#define INT_STACK_SET_WATERMARKS _IOW(INT_STACK_MAGIC, 4, struct int_stack_watermarks)
+#define INT_STACK_REDUCE _IOWR(INT_STACK_MAGIC, 5, struct int_stack_reduce)
+
+// with the record_mode module parameter set every write pushes one record
+// and every read pops one, a read shorter than the top record fails with
+// EMSGSIZE and leaves it in place, INT_STACK_SET_SIZE and the sizes below
+// count bytes of the stack and INT_STACK_PEEK is not available
+
+// copies the top of the stack without popping it, top value first
+// one call copies at most 64 pages worth of values, like a read, so a
+// count below the one asked for with size above it means the cap was hit
+// values spilled by spill_mb are never copied, size still counts them
+struct int_stack_peek {
+    __u64 values;   // user pointer to a buffer of count ints
+    __u32 count;    // in: buffer capacity, out: values copied
+    __u32 size;     // out: stack size at the moment of the copy
+};
+
+// registers an eventfd signalled when the stack size rises to high or
+// above, and again when it then falls to low or below, one registration
+// per stack replaces the previous one, eventfd -1 removes it and so does
+// closing the file the registration was made through
+// the eventfd counts crossings, the control page tells the current size
+struct int_stack_watermarks {
+    __s32 eventfd;
+    __u32 high;
+    __u32 low;      // below high
+};
+
+// sums and bounds up to count values below the top skip ones without
+// popping them, one call covers at most 64 pages worth of values so a
+// larger reduce takes several calls with growing skip, which agree only
+// while nothing pushes or pops in between
+// values spilled by spill_mb are never reduced but size counts them, so a
+// reduce that stops short of size did not cover the whole stack
+// with the track_minmax module option min and max of the whole stack are
+// kept next to every value, so a reduce with skip 0, count at or above
+// the stack size and INT_STACK_REDUCE_NO_SUM is not limited and costs O(1)
+// not available in record mode
+#define INT_STACK_REDUCE_NO_SUM 0x1
+
+struct int_stack_reduce {
+    __u32 skip;     // in: values at the top left out
+    __u32 count;    // in: values to reduce, out: values reduced
+    __u32 flags;    // in: INT_STACK_REDUCE_*
+    __u32 size;     // out: stack size at the moment of the reduce
+    __s64 sum;      // out: 0 with INT_STACK_REDUCE_NO_SUM
+    __s32 min;      // out: INT_MAX when nothing was reduced
+    __s32 max;      // out: INT_MIN when nothing was reduced
+};
+
+// control page, mapped read-only with mmap(NULL, page size, PROT_READ, ...)
+// it only mirrors statistics, the stack storage itself is never mapped,
+// so every push and pop still goes through write and read
+// kernel bumps seq before and after every update, so seq is odd while
+// the page is being written and readers retry if seq changed under them
+// INT_STACK_GET_STATS returns a consistent copy of the same structure
+// push/pop pairs that met through the elimination module option never
+// reach the stack and are not counted in pushed and popped
+// with the spill_mb module option size counts the values spilled to swap
+// too, so it can go above max_size, which bounds the values kept in memory
+// only stacks of at least one page of ints spill, smaller ones reject
+// writes when full as before, and while values are spilled
+// INT_STACK_SET_SIZE fails with EBUSY for sizes below that
+// with the drop_oldest module option a write to a full stack evicts its
+// oldest values and always succeeds, so does INT_STACK_SET_SIZE below the
+// current size, evictions show in sysfs evicted and are not counted in
+// popped
+struct int_stack_ctl {
+    __u32 seq;
+    __u32 size;
+    __u32 max_size;
+    __u32 high_water;   // largest size seen over the lifetime of the stack
+    __u64 pushed;   // values or records pushed over the lifetime of the stack
+    __u64 popped;   // values or records popped over the lifetime of the stack
+};
+
+#endif
@@ -0,0 +1,1761 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/mm.h>
+#include <linux/io.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ioctl.h>
+#include <linux/usb.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+#include <linux/shrinker.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/eventfd.h>
+#include <linux/shmem_fs.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/sizes.h>
+
+#include "int_stack.h"
+#include "stack_core.h"
+
+#define CREATE_TRACE_POINTS
+#include "int_stack_trace.h"
+
+#define DEVICE_NAME "int_stack"
+#define CLASS_NAME "int_stack_class"
+
+#define USB_KEY_VENDOR_ID 0x090c
+#define USB_KEY_PRODUCT_ID 0x1000
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Artyom Shaposhnikov");
+MODULE_VERSION("0.2");
+
+#define DEFAULT_MAX_STACK_SIZE 10
+#define DEFAULT_MAX_RECORD_BYTES PAGE_SIZE
+#define MAX_DEVICES 64
+
+// values moved per call that fit into an on-stack bounce buffer
+#define BOUNCE_BUF_INTS 32
+
+// upper bound on values moved by one call, keeps bounce buffers small
+// on huge stacks, callers see a short count and come back for the rest
+#define MAX_BATCH_INTS (64 * STACK_CORE_CHUNK_INTS)
+
+// largest capacity INT_STACK_SET_SIZE takes, in whole chunks whose
+// size in bytes still fits the u32 sizes of the control page
+#define MAX_STACK_INTS min_t(unsigned int, STACK_CORE_MAX_INTS, \
+                             UINT_MAX / sizeof(int) / STACK_CORE_CHUNK_INTS * STACK_CORE_CHUNK_INTS)
+
+// largest record a single write can push in record mode
+#define MAX_RECORD_BYTES (MAX_BATCH_INTS * sizeof(int))
+
+struct int_stack {
+    struct stack_core core;     // values, size and the lock guarding them
+    struct int_stack_ctl *ctl;  // page exported to userspace through mmap
+    wait_queue_head_t readq;    // readers waiting for values
+    wait_queue_head_t writeq;   // writers waiting for room
+    int node;                   // memory node of the stack, or NUMA_NO_NODE
+    struct delayed_work trim_work;  // gives back chunks once the stack drained
+    struct list_head list;      // entry in stack_list
+
+    // INT_STACK_SET_WATERMARKS registration, wm_lock nests inside the stack lock
+    spinlock_t wm_lock;
+    struct eventfd_ctx *wm_ctx; // NULL when nothing is registered
+    struct file *wm_owner;      // file that registered wm_ctx
+    unsigned int wm_high;
+    unsigned int wm_low;
+    bool wm_above;              // size reached wm_high and did not fall to wm_low since
+
+    // overflow tier, chunk i of the file holds the i-th spilled chunk from the bottom
+    struct mutex spill_lock;    // serializes spilling and loading back
+    struct file *spill_file;    // shmem, created on the first spill
+
+    u64 evicted;                // values dropped by drop_oldest, under the core lock
+
+    // record mode staging, allocated with the stack so records never allocate
+    struct mutex rec_lock;      // one record read or write at a time uses rec_buf
+    void *rec_buf;              // MAX_RECORD_BYTES
+};
+
+// one shared stack per device minor
+static struct int_stack **stacks = NULL;
+
+// every live stack, shared and private, for the shrinker
+static LIST_HEAD(stack_list);
+static DEFINE_MUTEX(stack_list_lock);
+
+static struct shrinker *stack_shrinker;
+
+// latency histograms keep one bucket per power of two nanoseconds
+#define LAT_BUCKETS 32
+
+// counters are per CPU so the data path never shares a cache line for them,
+// debugfs sums them over all CPUs on read
+struct int_stack_stats {
+    u64 pushes;         // values pushed
+    u64 pops;           // values popped
+    u64 empty_reads;    // reads that found the stack empty
+    u64 full_writes;    // writes that found the stack full
+    u64 resizes;
+    u64 bytes_copied;   // bytes moved to and from userspace
+    u64 contended;      // stack lock was already held when taking it
+    u64 remote_ops;     // pushes and pops from a CPU off the stack's node
+    u64 trimmed;        // chunks given back after a drain or to the shrinker
+    u64 elim_hits;      // single value pushes and pops that met their counterpart
+    u64 elim_misses;    // single value pushes and pops that took the lock after all
+    u64 spills;         // chunks moved from the bottom of the stack to the spill file
+    u64 unspills;       // chunks loaded back from the spill file
+    u64 evicted;        // oldest values dropped to make room for pushes
+    u64 lost;           // popped values or records that neither reached the user nor fit back
+    u64 push_lat[LAT_BUCKETS];
+    u64 pop_lat[LAT_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct int_stack_stats, stack_stats);
+
+static struct dentry *debugfs_dir;
+
+static bool private_stacks = false;
+module_param(private_stacks, bool, 0444);
+MODULE_PARM_DESC(private_stacks, "Give every open of the device its own stack");
+
+static unsigned int nr_devices = 1;
+module_param(nr_devices, uint, 0444);
+MODULE_PARM_DESC(nr_devices, "Number of independent stack devices, named int_stack0..N-1 when above 1");
+
+static bool record_mode = false;
+module_param(record_mode, bool, 0444);
+MODULE_PARM_DESC(record_mode, "Every write pushes one variable-length record and every read pops one, sizes count bytes");
+
+static bool elimination = false;
+module_param(elimination, bool, 0444);
+MODULE_PARM_DESC(elimination, "Let contended single value pushes and pops exchange values without the stack lock");
+
+static bool track_minmax = false;
+module_param(track_minmax, bool, 0444);
+MODULE_PARM_DESC(track_minmax, "Keep min and max of an int stack next to every value, for INT_STACK_REDUCE without a scan");
+
+static bool drop_oldest = false;
+module_param(drop_oldest, bool, 0444);
+MODULE_PARM_DESC(drop_oldest, "A push into a full int stack evicts its oldest values instead of failing or blocking");
+
+static unsigned int spill_mb = 0;
+module_param(spill_mb, uint, 0444);
+MODULE_PARM_DESC(spill_mb, "Swappable space a full int stack spills its bottom to instead of rejecting pushes, 0 disables, needs max_size of a page of ints or more");
+
+static unsigned int trim_floor_kb = 256;
+module_param(trim_floor_kb, uint, 0644);
+MODULE_PARM_DESC(trim_floor_kb, "Storage every stack keeps allocated after a drain or under memory pressure");
+
+static unsigned int trim_delay_ms = 1000;
+module_param(trim_delay_ms, uint, 0644);
+MODULE_PARM_DESC(trim_delay_ms, "Delay before a drained stack gives back its storage");
+
+// named apart from the per-CPU numa_node behind numa_node_id()
+static int stack_numa_node = NUMA_NO_NODE;
+module_param_named(numa_node, stack_numa_node, int, 0444);
+MODULE_PARM_DESC(numa_node, "Memory node for all stacks, by default several devices are spread over online nodes");
+
+static struct {
+    struct cdev cdev;
+    dev_t dev_number;
+    struct class *class;
+    bool device_created;
+} int_stack_device;
+
+// USB device tracking 
+static struct usb_device *usb_key_device = NULL;
+
+// file operation prototypes
+static int int_stack_open(struct inode *inode, struct file *filp);
+static int int_stack_release(struct inode *inode, struct file *filp);
+static ssize_t int_stack_read_iter(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t int_stack_write_iter(struct kiocb *iocb, struct iov_iter *from);
+static long int_stack_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+static int int_stack_mmap(struct file *filp, struct vm_area_struct *vma);
+static __poll_t int_stack_poll(struct file *filp, poll_table *wait);
+
+// file operations structure
+static struct file_operations int_stack_fops = {
+    .open = int_stack_open,
+    .release = int_stack_release,
+    .read_iter = int_stack_read_iter,
+    .write_iter = int_stack_write_iter,
+    .splice_read = copy_splice_read,
+    .splice_write = iter_file_splice_write,
+    .unlocked_ioctl = int_stack_ioctl,
+    .mmap = int_stack_mmap,
+    .poll = int_stack_poll,
+    .owner = THIS_MODULE
+};
+
+// sizes seen by userspace count ints, or bytes in record mode
+static inline unsigned int user_size(unsigned int ints)
+{
+    return record_mode ? ints * sizeof(int) : ints;
+}
+
+// values in memory and in the spill file, spilled stays 0 in record mode
+static inline unsigned int stack_total(struct stack_core *core)
+{
+    return core->size + core->spilled * STACK_CORE_CHUNK_INTS;
+}
+
+static inline unsigned int lat_bucket(u64 ns)
+{
+    return ns ? min_t(unsigned int, ilog2(ns), LAT_BUCKETS - 1) : 0;
+}
+
+// mirrors stack state into the control page, called under the stack lock
+static void publish_ctl(struct int_stack *stack, unsigned int pushed, unsigned int popped)
+{
+    struct int_stack_ctl *ctl = stack->ctl;
+
+    WRITE_ONCE(ctl->seq, ctl->seq + 1);
+    smp_wmb();
+
+    WRITE_ONCE(ctl->size, user_size(stack_total(&stack->core)));
+    WRITE_ONCE(ctl->max_size, user_size(stack->core.max_size));
+    if (user_size(stack_total(&stack->core)) > ctl->high_water) {
+        WRITE_ONCE(ctl->high_water, user_size(stack_total(&stack->core)));
+    }
+    WRITE_ONCE(ctl->pushed, ctl->pushed + pushed);
+    WRITE_ONCE(ctl->popped, ctl->popped + popped);
+
+    smp_wmb();
+    WRITE_ONCE(ctl->seq, ctl->seq + 1);
+}
+
+// lock-free read of the control page, monitoring never touches the stack lock
+static void read_ctl(struct int_stack *stack, struct int_stack_ctl *snap)
+{
+    struct int_stack_ctl *ctl = stack->ctl;
+    u32 seq;
+
+    do {
+        seq = READ_ONCE(ctl->seq);
+        smp_rmb();
+
+        snap->seq = seq;
+        snap->size = READ_ONCE(ctl->size);
+        snap->max_size = READ_ONCE(ctl->max_size);
+        snap->high_water = READ_ONCE(ctl->high_water);
+        snap->pushed = READ_ONCE(ctl->pushed);
+        snap->popped = READ_ONCE(ctl->popped);
+
+        smp_rmb();
+    } while ((seq & 1) || seq != READ_ONCE(ctl->seq));
+}
+
+// counts data path operations that cross to another node's memory
+static inline void count_remote(struct int_stack *stack)
+{
+    if (stack->node != NUMA_NO_NODE && numa_node_id() != stack->node) {
+        this_cpu_inc(stack_stats.remote_ops);
+    }
+}
+
+// floor in stack positions, the same for int and record stacks
+static inline unsigned int trim_floor(void)
+{
+    return READ_ONCE(trim_floor_kb) * (1024 / sizeof(int));
+}
+
+// shrinking lags growth twice over, the stack has to fall below a quarter
+// of its allocated storage and stay idle for trim_delay_ms, and the trim
+// then keeps twice the size that is left, so a stack that oscillates
+// around one size does not keep freeing and allocating the same chunks
+static inline void schedule_trim(struct int_stack *stack)
+{
+    struct stack_core *core = &stack->core;
+    unsigned int backed = core->populated * STACK_CORE_CHUNK_INTS;
+
+    if (backed > trim_floor() && core->size < backed / 4 &&
+        !delayed_work_pending(&stack->trim_work)) {
+        schedule_delayed_work(&stack->trim_work, msecs_to_jiffies(READ_ONCE(trim_delay_ms)));
+    }
+}
+
+static void trim_work_fn(struct work_struct *work)
+{
+    struct int_stack *stack = container_of(to_delayed_work(work), struct int_stack, trim_work);
+    unsigned int keep = max(trim_floor(), 2 * stack_core_size(&stack->core));
+
+    this_cpu_add(stack_stats.trimmed, stack_core_trim(&stack->core, keep, UINT_MAX));
+}
+
+// signals the watermark eventfd on crossings, idle stacks only pay
+// for the pointer check
+static void check_watermarks(struct int_stack *stack)
+{
+    unsigned int size;
+
+    if (!READ_ONCE(stack->wm_ctx)) {
+        return;
+    }
+
+    // the size userspace sees, spilling and loading back never cross
+    size = user_size(stack_total(&stack->core));
+    spin_lock(&stack->wm_lock);
+    if (stack->wm_ctx) {
+        if (!stack->wm_above && size >= stack->wm_high) {
+            stack->wm_above = true;
+            eventfd_signal(stack->wm_ctx);
+        } else if (stack->wm_above && size <= stack->wm_low) {
+            stack->wm_above = false;
+            eventfd_signal(stack->wm_ctx);
+        }
+    }
+    spin_unlock(&stack->wm_lock);
+}
+
+// drops the registration, with filp given only one made through filp
+static void clear_watermarks(struct int_stack *stack, struct file *filp)
+{
+    struct eventfd_ctx *old = NULL;
+
+    spin_lock(&stack->wm_lock);
+    if (!filp || stack->wm_owner == filp) {
+        old = stack->wm_ctx;
+        WRITE_ONCE(stack->wm_ctx, NULL);
+        stack->wm_owner = NULL;
+    }
+    spin_unlock(&stack->wm_lock);
+
+    if (old) {
+        eventfd_ctx_put(old);
+    }
+}
+
+// stack_core hook, runs under the stack lock
+static void stack_event(struct stack_core *core, enum stack_core_event event,
+                        unsigned int count, int value)
+{
+    struct int_stack *stack = container_of(core, struct int_stack, core);
+
+    switch (event) {
+    case STACK_CORE_PUSH:
+        count_remote(stack);
+        publish_ctl(stack, count, 0);
+        trace_int_stack_push(value, count, core->size);
+        this_cpu_add(stack_stats.pushes, count);
+        check_watermarks(stack);
+        break;
+
+    case STACK_CORE_POP:
+        count_remote(stack);
+        publish_ctl(stack, 0, count);
+        trace_int_stack_pop(value, count, core->size);
+        this_cpu_add(stack_stats.pops, count);
+        schedule_trim(stack);
+        check_watermarks(stack);
+        break;
+
+    case STACK_CORE_RESIZE:
+        publish_ctl(stack, 0, 0);
+        trace_int_stack_resize(count, core->max_size, core->size);
+        this_cpu_inc(stack_stats.resizes);
+        check_watermarks(stack);
+        break;
+
+    case STACK_CORE_CONTENDED:
+        this_cpu_inc(stack_stats.contended);
+        break;
+
+    // without the stack lock, the stack did not change
+    case STACK_CORE_ELIM_HIT:
+        this_cpu_inc(stack_stats.elim_hits);
+        break;
+
+    case STACK_CORE_ELIM_MISS:
+        this_cpu_inc(stack_stats.elim_misses);
+        break;
+
+    // the total size stays the same, only where the values live changes
+    case STACK_CORE_SPILL:
+        this_cpu_inc(stack_stats.spills);
+        break;
+
+    case STACK_CORE_UNSPILL:
+        this_cpu_inc(stack_stats.unspills);
+        break;
+
+    // the push that follows publishes the size
+    case STACK_CORE_EVICT:
+        stack->evicted += count;
+        this_cpu_add(stack_stats.evicted, count);
+        break;
+    }
+}
+
+static int stack_push(struct int_stack *stack, const int *values, unsigned int n)
+{
+    int ret = stack_core_push(&stack->core, values, n);
+
+    if (ret > 0 && wq_has_sleeper(&stack->readq)) {
+        wake_up_interruptible(&stack->readq);
+    }
+    return ret;
+}
+
+// returns values a read could not deliver, evicting nothing for them
+static int stack_push_back(struct int_stack *stack, const int *values, unsigned int n)
+{
+    int ret = stack_core_push_back(&stack->core, values, n);
+
+    if (ret > 0 && wq_has_sleeper(&stack->readq)) {
+        wake_up_interruptible(&stack->readq);
+    }
+    return ret;
+}
+
+static int stack_push_record(struct int_stack *stack, const void *data, unsigned int len)
+{
+    int ret = stack_core_push_record(&stack->core, data, len);
+
+    if (ret > 0 && wq_has_sleeper(&stack->readq)) {
+        wake_up_interruptible(&stack->readq);
+    }
+    return ret;
+}
+
+static unsigned int stack_pop_record(struct int_stack *stack, void *out, unsigned int cap)
+{
+    unsigned int len = stack_core_pop_record(&stack->core, out, cap);
+
+    if (len && len <= cap && wq_has_sleeper(&stack->writeq)) {
+        wake_up_interruptible(&stack->writeq);
+    }
+    return len;
+}
+
+static unsigned int stack_pop(struct int_stack *stack, int *out, unsigned int n)
+{
+    n = stack_core_pop(&stack->core, out, n);
+
+    if (n && wq_has_sleeper(&stack->writeq)) {
+        wake_up_interruptible(&stack->writeq);
+    }
+    return n;
+}
+
+// overflow tier, spill_mb of shmem under the bottom of every int stack
+static inline bool spill_enabled(void)
+{
+    return spill_mb && !record_mode && !drop_oldest && !track_minmax;
+}
+
+// capacity of the spill file in chunks
+static inline unsigned int spill_limit(void)
+{
+    return spill_mb * (SZ_1M / PAGE_SIZE);
+}
+
+// racy, for wait conditions and poll
+static inline bool stack_has_values(struct int_stack *stack)
+{
+    return stack_core_size(&stack->core) > 0 || READ_ONCE(stack->core.spilled) > 0;
+}
+
+// moves the bottom chunk of a full stack into the spill file
+// returns 0 when room was made, -ERANGE when there is nothing to spill
+// or no space left to spill it to
+static int spill_bottom(struct int_stack *stack)
+{
+    struct folio *folio;
+    struct file *file;
+    unsigned int index;
+    void *addr;
+    int *chunk;
+    int ret = 0;
+
+    // only whole chunks spill, a smaller stack never fills one
+    if (!spill_enabled() || stack_core_max_size(&stack->core) < STACK_CORE_CHUNK_INTS) {
+        return -ERANGE;
+    }
+
+    mutex_lock(&stack->spill_lock);
+
+    // spilled only changes under spill_lock
+    index = stack->core.spilled;
+    if (index >= spill_limit()) {
+        ret = -ERANGE;
+        goto out;
+    }
+
+    if (!stack->spill_file) {
+        file = shmem_file_setup("int_stack_spill", (loff_t)spill_limit() << PAGE_SHIFT,
+                                VM_NORESERVE);
+        if (IS_ERR(file)) {
+            ret = PTR_ERR(file);
+            goto out;
+        }
+        stack->spill_file = file;
+    }
+
+    // the page is in hand before the chunk leaves the stack,
+    // so nothing can fail with the values in flight
+    folio = shmem_read_folio(stack->spill_file->f_mapping, index);
+    if (IS_ERR(folio)) {
+        ret = PTR_ERR(folio);
+        goto out;
+    }
+
+    chunk = stack_core_spill(&stack->core);
+    if (chunk) {
+        addr = kmap_local_folio(folio, offset_in_folio(folio, (loff_t)index << PAGE_SHIFT));
+        memcpy(addr, chunk, PAGE_SIZE);
+        kunmap_local(addr);
+        folio_mark_dirty(folio);
+        kvfree(chunk);
+    } else {
+        ret = -ERANGE;
+    }
+    folio_put(folio);
+
+out:
+    mutex_unlock(&stack->spill_lock);
+    return ret;
+}
+
+// loads the most recently spilled chunk back under the bottom of the stack
+// returns 0, or -ERANGE with the chunk left in the file when the stack
+// has no room for it, because pushes refilled it in the meantime
+static int unspill_bottom(struct int_stack *stack)
+{
+    struct folio *folio;
+    unsigned int index;
+    loff_t pos;
+    void *addr;
+    int *chunk;
+    int ret = 0;
+
+    mutex_lock(&stack->spill_lock);
+
+    if (stack->core.spilled == 0) {
+        goto out;
+    }
+    index = stack->core.spilled - 1;
+    pos = (loff_t)index << PAGE_SHIFT;
+
+    chunk = kvmalloc_node(PAGE_SIZE, GFP_KERNEL, stack->node);
+    if (!chunk) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    folio = shmem_read_folio(stack->spill_file->f_mapping, index);
+    if (IS_ERR(folio)) {
+        kvfree(chunk);
+        ret = PTR_ERR(folio);
+        goto out;
+    }
+
+    addr = kmap_local_folio(folio, offset_in_folio(folio, pos));
+    memcpy(chunk, addr, PAGE_SIZE);
+    kunmap_local(addr);
+    folio_put(folio);
+
+    ret = stack_core_unspill(&stack->core, chunk);
+    if (ret < 0) {
+        kvfree(chunk);
+        goto out;
+    }
+
+    // the copy in the file is stale now, its page or swap slot goes
+    shmem_truncate_range(file_inode(stack->spill_file), pos, pos + PAGE_SIZE - 1);
+
+out:
+    mutex_unlock(&stack->spill_lock);
+    return ret;
+}
+
+static int stack_resize(struct int_stack *stack, unsigned int new_size)
+{
+    int ret = stack_core_resize(&stack->core, new_size);
+
+    if (ret == 0) {
+        wake_up_interruptible(&stack->writeq);
+    }
+    return ret;
+}
+
+// everything the data path touches is allocated on node
+static struct int_stack *alloc_stack(int node)
+{
+    struct int_stack *s;
+    struct page *ctl_page;
+    int ret;
+
+    s = kmalloc_node(sizeof(struct int_stack), GFP_KERNEL, node);
+    if (!s) {
+        return NULL;
+    }
+    s->node = node;
+
+    init_waitqueue_head(&s->readq);
+    init_waitqueue_head(&s->writeq);
+
+    if (record_mode) {
+        ret = stack_core_init_records(&s->core, DEFAULT_MAX_RECORD_BYTES / sizeof(int),
+                                      stack_event, node);
+    } else {
+        ret = stack_core_init(&s->core, DEFAULT_MAX_STACK_SIZE, stack_event, node);
+    }
+    if (ret < 0) {
+        kfree(s);
+        return NULL;
+    }
+    stack_core_set_elimination(&s->core, elimination);
+    stack_core_set_drop_oldest(&s->core, drop_oldest);
+    if (track_minmax && stack_core_track_bounds(&s->core) < 0) {
+        stack_core_destroy(&s->core);
+        kfree(s);
+        return NULL;
+    }
+    s->evicted = 0;
+
+    s->rec_buf = NULL;
+    if (record_mode) {
+        s->rec_buf = kvmalloc_node(MAX_RECORD_BYTES, GFP_KERNEL, node);
+        if (!s->rec_buf) {
+            stack_core_destroy(&s->core);
+            kfree(s);
+            return NULL;
+        }
+    }
+
+    ctl_page = alloc_pages_node(node, GFP_KERNEL | __GFP_ZERO, 0);
+    if (!ctl_page) {
+        kvfree(s->rec_buf);
+        stack_core_destroy(&s->core);
+        kfree(s);
+        return NULL;
+    }
+    s->ctl = page_address(ctl_page);
+    s->ctl->max_size = user_size(s->core.max_size);
+
+    INIT_DELAYED_WORK(&s->trim_work, trim_work_fn);
+    mutex_init(&s->spill_lock);
+    s->spill_file = NULL;
+    mutex_init(&s->rec_lock);
+    spin_lock_init(&s->wm_lock);
+    s->wm_ctx = NULL;
+    s->wm_owner = NULL;
+    mutex_lock(&stack_list_lock);
+    list_add(&s->list, &stack_list);
+    mutex_unlock(&stack_list_lock);
+
+    return s;
+}
+
+static void free_stack(struct int_stack *s)
+{
+    if (s) {
+        mutex_lock(&stack_list_lock);
+        list_del(&s->list);
+        mutex_unlock(&stack_list_lock);
+        cancel_delayed_work_sync(&s->trim_work);
+        clear_watermarks(s, NULL);
+        if (s->spill_file) {
+            fput(s->spill_file);
+        }
+        mutex_destroy(&s->spill_lock);
+        mutex_destroy(&s->rec_lock);
+        kvfree(s->rec_buf);
+
+        free_page((unsigned long)s->ctl);
+        stack_core_destroy(&s->core);
+        kfree(s);
+    }
+}
+
+static int int_stack_open(struct inode *inode, struct file *filp)
+{
+    // private stacks without a numa_node land on the opener's node
+    if (private_stacks) {
+        filp->private_data = alloc_stack(stack_numa_node);
+        if (!filp->private_data) {
+            return -ENOMEM;
+        }
+    } else {
+        filp->private_data = stacks[iminor(inode)];
+    }
+
+    pr_info("INT_STACK: Device opened\n");
+    return 0;
+}
+
+static int int_stack_release(struct inode *inode, struct file *filp)
+{
+    if (private_stacks) {
+        free_stack(filp->private_data);
+    } else {
+        clear_watermarks(filp->private_data, filp);
+    }
+
+    pr_info("INT_STACK: Device closed\n");
+    return 0;
+}
+
+// reverses n elements in place
+static void reverse_ints(int *data, unsigned int n)
+{
+    unsigned int i;
+    int tmp;
+
+    for (i = 0; i < n / 2; i++) {
+        tmp = data[i];
+        data[i] = data[n - 1 - i];
+        data[n - 1 - i] = tmp;
+    }
+}
+
+// blocks until the stack has values, unless the request is non-blocking
+static int wait_readable(struct int_stack *stack, bool nonblock)
+{
+    if (stack_has_values(stack)) {
+        return 0;
+    }
+
+    this_cpu_inc(stack_stats.empty_reads);
+    trace_int_stack_empty(0, stack_core_max_size(&stack->core));
+    if (nonblock) {
+        return -EAGAIN;
+    }
+
+    return wait_event_interruptible(stack->readq, stack_has_values(stack));
+}
+
+// room for ints more, or none ever after a resize below ints,
+// which the caller sees when it checks the size again
+static inline bool stack_has_room(struct int_stack *stack, unsigned int ints)
+{
+    unsigned int max_size = stack_core_max_size(&stack->core);
+
+    return ints > max_size || stack_core_size(&stack->core) + ints <= max_size;
+}
+
+// blocks until the stack has room for ints more, unless the request is non-blocking
+static int wait_writable(struct int_stack *stack, bool nonblock, unsigned int ints)
+{
+    if (stack_has_room(stack, ints)) {
+        return 0;
+    }
+
+    this_cpu_inc(stack_stats.full_writes);
+    trace_int_stack_full(stack_core_size(&stack->core), stack_core_max_size(&stack->core));
+    if (nonblock) {
+        return -EAGAIN;
+    }
+
+    return wait_event_interruptible(stack->writeq, stack_has_room(stack, ints));
+}
+
+// user memory is never touched under the stack lock, values are staged
+// in a bounce buffer that lives on the kernel stack for small transfers
+static int *get_bounce_buf(int *small, unsigned int n)
+{
+    if (n <= BOUNCE_BUF_INTS) {
+        return small;
+    }
+
+    return kvmalloc_array(n, sizeof(int), GFP_KERNEL);
+}
+
+static void put_bounce_buf(int *buf, int *small)
+{
+    if (buf != small) {
+        kvfree(buf);
+    }
+}
+
+static bool iocb_nonblock(struct kiocb *iocb)
+{
+    return (iocb->ki_filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+}
+
+// records are staged in the buffer allocated with the stack, so neither
+// path allocates per record
+// pops one whole record, a buffer too short for the top record gets -EMSGSIZE
+static ssize_t record_read(struct int_stack *stack, struct kiocb *iocb, struct iov_iter *to)
+{
+    size_t count = iov_iter_count(to);
+    unsigned int len;
+    size_t bytes;
+    u64 start;
+    ssize_t ret;
+
+    // every record fits the staging buffer, so one pop always does
+    for (;;) {
+        ret = wait_readable(stack, iocb_nonblock(iocb));
+        if (ret < 0) {
+            return ret;
+        }
+
+        mutex_lock(&stack->rec_lock);
+        start = ktime_get_ns();
+        len = stack_pop_record(stack, stack->rec_buf, min_t(size_t, MAX_RECORD_BYTES, count));
+        this_cpu_inc(stack_stats.pop_lat[lat_bucket(ktime_get_ns() - start)]);
+        if (len) {
+            break;
+        }
+        // another reader drained the stack first
+        mutex_unlock(&stack->rec_lock);
+    }
+
+    if (len > count) {
+        ret = -EMSGSIZE;
+        goto out;
+    }
+
+    bytes = copy_to_iter(stack->rec_buf, len, to);
+    if (bytes < len) {
+        // the user sees the fault, the record goes back untouched
+        // unless writers filled the stack in the meantime
+        iov_iter_revert(to, bytes);
+        if (stack_push_record(stack, stack->rec_buf, len) < 0) {
+            this_cpu_inc(stack_stats.lost);
+            pr_warn_ratelimited("INT_STACK: record of %u bytes lost after a faulting read\n", len);
+        }
+        ret = -EFAULT;
+        goto out;
+    }
+
+    ret = len;
+    this_cpu_add(stack_stats.bytes_copied, ret);
+
+out:
+    mutex_unlock(&stack->rec_lock);
+    return ret;
+}
+
+static ssize_t record_write(struct int_stack *stack, struct kiocb *iocb, struct iov_iter *from)
+{
+    size_t count = iov_iter_count(from);
+    u64 start;
+    ssize_t ret;
+
+    if (count == 0) {
+        return 0;
+    }
+    if (count > MAX_RECORD_BYTES) {
+        return -EMSGSIZE;
+    }
+
+    for (;;) {
+        // checked on every round, the stack may shrink while the writer waits
+        if (stack_core_record_ints(count) > stack_core_max_size(&stack->core)) {
+            return -EMSGSIZE;
+        }
+
+        mutex_lock(&stack->rec_lock);
+        if (!copy_from_iter_full(stack->rec_buf, count, from)) {
+            mutex_unlock(&stack->rec_lock);
+            return -EFAULT;
+        }
+
+        start = ktime_get_ns();
+        ret = stack_push_record(stack, stack->rec_buf, count);
+        this_cpu_inc(stack_stats.push_lat[lat_bucket(ktime_get_ns() - start)]);
+        mutex_unlock(&stack->rec_lock);
+        if (ret != -ERANGE) {
+            break;
+        }
+
+        // readers need the staging buffer to make room, so it is not
+        // held while waiting and the record is copied in again after
+        iov_iter_revert(from, count);
+        ret = wait_writable(stack, iocb_nonblock(iocb), stack_core_record_ints(count));
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (ret < 0) {
+        iov_iter_revert(from, count);
+        return ret;
+    }
+
+    this_cpu_add(stack_stats.bytes_copied, ret);
+    return ret;
+}
+
+static ssize_t int_stack_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct int_stack *stack = iocb->ki_filp->private_data;
+    size_t count = iov_iter_count(to);
+    int small[BOUNCE_BUF_INTS];
+    unsigned int n, popped, copied, lost;
+    size_t bytes;
+    u64 start;
+    int *values;
+    ssize_t ret = 0;
+
+    if (record_mode) {
+        return record_read(stack, iocb, to);
+    }
+
+    if (count < sizeof(int)) {
+        return -EINVAL;
+    }
+
+    do {
+        ret = wait_readable(stack, iocb_nonblock(iocb));
+        if (ret < 0) {
+            return ret;
+        }
+
+        // values in memory ran out, the top of the spilled ones comes back,
+        // a stack still empty after a failed load would loop here forever
+        if (stack_core_size(&stack->core) == 0 && READ_ONCE(stack->core.spilled)) {
+            ret = unspill_bottom(stack);
+            if (ret < 0 && (ret != -ERANGE || stack_core_size(&stack->core) == 0)) {
+                return ret;
+            }
+        }
+
+        // sizing the buffer by a racy look at the stack, stack_pop rechecks
+        n = min_t(size_t, count / sizeof(int), max(stack_core_size(&stack->core), 1U));
+        n = min(n, MAX_BATCH_INTS);
+
+        // faulting the user buffer in first, so values are only popped
+        // for memory that can take them
+        bytes = n * sizeof(int);
+        bytes -= fault_in_iov_iter_writeable(to, bytes);
+        if (bytes < sizeof(int)) {
+            return -EFAULT;
+        }
+        n = bytes / sizeof(int);
+
+        values = get_bounce_buf(small, n);
+        if (!values) {
+            return -ENOMEM;
+        }
+
+        start = ktime_get_ns();
+        popped = stack_pop(stack, values, n);
+        this_cpu_inc(stack_stats.pop_lat[lat_bucket(ktime_get_ns() - start)]);
+        if (popped == 0) {
+            // another reader drained the stack first
+            put_bounce_buf(values, small);
+        }
+    } while (popped == 0);
+
+    // one copy covers all segments of a readv or a splice into a pipe
+    bytes = copy_to_iter(values, popped * sizeof(int), to);
+    copied = bytes / sizeof(int);
+    if (copied < popped) {
+        // the pages went away again after being faulted in, the values
+        // go back unless writers filled the stack in the meantime
+        iov_iter_revert(to, bytes % sizeof(int));
+        reverse_ints(values + copied, popped - copied);
+        lost = popped - copied;
+        ret = stack_push_back(stack, values + copied, lost);
+        if (ret > 0) {
+            lost -= ret;
+        }
+        if (lost) {
+            this_cpu_add(stack_stats.lost, lost);
+            pr_warn_ratelimited("INT_STACK: %u values lost after a faulting read\n", lost);
+        }
+    }
+
+    if (copied == 0) {
+        ret = -EFAULT;
+        goto out;
+    }
+
+    ret = copied * sizeof(int);
+    this_cpu_add(stack_stats.bytes_copied, ret);
+
+out:
+    put_bounce_buf(values, small);
+    return ret;
+}
+
+static ssize_t int_stack_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct int_stack *stack = iocb->ki_filp->private_data;
+    size_t count = iov_iter_count(from);
+    int small[BOUNCE_BUF_INTS];
+    unsigned int n, copied;
+    size_t bytes;
+    u64 start;
+    int *values;
+    ssize_t ret = 0;
+
+    if (record_mode) {
+        return record_write(stack, iocb, from);
+    }
+
+    // checking if count is enough to hold an integer
+    if (count < sizeof(int)) {
+        return -EINVAL;
+    }
+
+    n = min_t(size_t, count / sizeof(int), max(stack_core_max_size(&stack->core), 1U));
+    n = min(n, MAX_BATCH_INTS);
+
+    values = get_bounce_buf(small, n);
+    if (!values) {
+        return -ENOMEM;
+    }
+
+    // one copy gathers all segments of a writev or a splice from a pipe
+    bytes = copy_from_iter(values, n * sizeof(int), from);
+    copied = bytes / sizeof(int);
+    if (copied == 0) {
+        iov_iter_revert(from, bytes);
+        ret = -EFAULT;
+        goto out;
+    }
+
+    // pushing as many values as fit, last one in the buffer ends up on top
+    for (;;) {
+        start = ktime_get_ns();
+        ret = stack_push(stack, values, copied);
+        this_cpu_inc(stack_stats.push_lat[lat_bucket(ktime_get_ns() - start)]);
+        if (ret != -ERANGE) {
+            break;
+        }
+
+        // a full stack with a spill tier makes room instead of waiting
+        ret = spill_bottom(stack);
+        if (ret == 0) {
+            continue;
+        }
+        if (ret != -ERANGE) {
+            break;
+        }
+
+        ret = wait_writable(stack, iocb_nonblock(iocb), 1);
+        if (ret < 0) {
+            break;
+        }
+    }
+
+    if (ret < 0) {
+        iov_iter_revert(from, bytes);
+        goto out;
+    }
+
+    // leaving values that did not fit in the iterator for the next call
+    iov_iter_revert(from, bytes - ret * sizeof(int));
+    ret *= sizeof(int);
+    this_cpu_add(stack_stats.bytes_copied, ret);
+
+out:
+    put_bounce_buf(values, small);
+    return ret;
+}
+
+static long peek_ioctl(struct int_stack *stack, struct int_stack_peek __user *argp)
+{
+    struct int_stack_peek peek;
+    int small[BOUNCE_BUF_INTS];
+    unsigned int n;
+    int *values;
+    long ret = 0;
+
+    if (copy_from_user(&peek, argp, sizeof(peek))) {
+        return -EFAULT;
+    }
+
+    // one snapshot is bounded like a read, so the lock is held briefly
+    n = min3(peek.count, max(stack_core_size(&stack->core), 1U), MAX_BATCH_INTS);
+
+    values = get_bounce_buf(small, n);
+    if (!values) {
+        return -ENOMEM;
+    }
+
+    peek.count = stack_core_peek(&stack->core, values, n, &peek.size);
+
+    if (copy_to_user(u64_to_user_ptr(peek.values), values, peek.count * sizeof(int)) ||
+        copy_to_user(argp, &peek, sizeof(peek))) {
+        ret = -EFAULT;
+    }
+
+    put_bounce_buf(values, small);
+    return ret;
+}
+
+static long reduce_ioctl(struct int_stack *stack, struct int_stack_reduce __user *argp)
+{
+    struct int_stack_reduce reduce;
+    struct stack_core_reduce r;
+    bool sum;
+
+    if (copy_from_user(&reduce, argp, sizeof(reduce))) {
+        return -EFAULT;
+    }
+    if (reduce.flags & ~INT_STACK_REDUCE_NO_SUM) {
+        return -EINVAL;
+    }
+    sum = !(reduce.flags & INT_STACK_REDUCE_NO_SUM);
+
+    // a scan holds the lock, so it is bounded like a read
+    reduce.count = stack_core_reduce(&stack->core, reduce.skip, reduce.count, MAX_BATCH_INTS,
+                                     sum, &r);
+    reduce.size = r.size;
+    reduce.sum = r.sum;
+    reduce.min = r.min;
+    reduce.max = r.max;
+
+    if (copy_to_user(argp, &reduce, sizeof(reduce))) {
+        return -EFAULT;
+    }
+
+    return 0;
+}
+
+static long watermarks_ioctl(struct int_stack *stack, struct file *filp,
+                             struct int_stack_watermarks __user *argp)
+{
+    struct int_stack_watermarks wm;
+    struct eventfd_ctx *ctx = NULL, *old;
+
+    if (copy_from_user(&wm, argp, sizeof(wm))) {
+        return -EFAULT;
+    }
+
+    if (wm.eventfd >= 0) {
+        if (wm.low >= wm.high) {
+            return -EINVAL;
+        }
+
+        ctx = eventfd_ctx_fdget(wm.eventfd);
+        if (IS_ERR(ctx)) {
+            return PTR_ERR(ctx);
+        }
+    } else if (wm.eventfd != -1) {
+        return -EBADF;
+    }
+
+    // the core lock keeps the size still until the new registration sees
+    // events, spilled values count as in check_watermarks
+    stack_core_hold(&stack->core);
+    spin_lock(&stack->wm_lock);
+    old = stack->wm_ctx;
+    stack->wm_high = wm.high;
+    stack->wm_low = wm.low;
+    // a stack already above high is only signalled once it falls to low
+    stack->wm_above = user_size(stack_total(&stack->core)) >= wm.high;
+    WRITE_ONCE(stack->wm_ctx, ctx);
+    stack->wm_owner = ctx ? filp : NULL;
+    spin_unlock(&stack->wm_lock);
+    stack_core_release(&stack->core);
+
+    if (old) {
+        eventfd_ctx_put(old);
+    }
+    return 0;
+}
+
+static long int_stack_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct int_stack *stack = filp->private_data;
+    int ret = 0;
+    unsigned int new_size;
+    struct int_stack_ctl snap;
+
+    if (_IOC_TYPE(cmd) != INT_STACK_MAGIC) {
+        return -ENOTTY;
+    }
+
+    switch (cmd) {
+    case INT_STACK_SET_SIZE:
+        if (copy_from_user(&new_size, (unsigned int *)arg, sizeof(unsigned int))) {
+            return -EFAULT;
+        }
+
+        // in record mode the size is given in bytes, rounded down to whole ints
+        if (record_mode) {
+            new_size /= sizeof(int);
+        }
+
+        if (new_size == 0 || new_size > MAX_STACK_INTS) {
+            return -EINVAL;
+        }
+
+        ret = stack_resize(stack, new_size);
+        break;
+
+    case INT_STACK_PEEK:
+        if (record_mode) {
+            return -EINVAL;
+        }
+        ret = peek_ioctl(stack, (struct int_stack_peek __user *)arg);
+        break;
+
+    case INT_STACK_GET_STATS:
+        read_ctl(stack, &snap);
+        if (copy_to_user((struct int_stack_ctl *)arg, &snap, sizeof(snap))) {
+            return -EFAULT;
+        }
+        break;
+
+    case INT_STACK_REDUCE:
+        if (record_mode) {
+            return -EINVAL;
+        }
+        ret = reduce_ioctl(stack, (struct int_stack_reduce __user *)arg);
+        break;
+
+    case INT_STACK_SET_WATERMARKS:
+        ret = watermarks_ioctl(stack, filp, (struct int_stack_watermarks __user *)arg);
+        break;
+
+    default:
+        ret = -ENOTTY;  // unknown command
+    }
+
+    return ret;
+}
+
+static int int_stack_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct int_stack *stack = filp->private_data;
+
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE) {
+        return -EINVAL;
+    }
+
+    // only the kernel writes the control page, under the stack lock
+    if (vma->vm_flags & VM_WRITE) {
+        return -EPERM;
+    }
+    vm_flags_mod(vma, VM_DONTEXPAND | VM_DONTDUMP, VM_MAYWRITE);
+
+    return remap_pfn_range(vma, vma->vm_start, virt_to_phys(stack->ctl) >> PAGE_SHIFT,
+                           PAGE_SIZE, vma->vm_page_prot);
+}
+
+static __poll_t int_stack_poll(struct file *filp, poll_table *wait)
+{
+    struct int_stack *stack = filp->private_data;
+    __poll_t mask = 0;
+    unsigned int size;
+
+    poll_wait(filp, &stack->readq, wait);
+    poll_wait(filp, &stack->writeq, wait);
+
+    size = stack_core_size(&stack->core);
+    if (stack_has_values(stack)) {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+    if (size < stack_core_max_size(&stack->core) || stack->core.drop_oldest ||
+        (spill_enabled() && stack_core_max_size(&stack->core) >= STACK_CORE_CHUNK_INTS &&
+         READ_ONCE(stack->core.spilled) < spill_limit())) {
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    }
+
+    return mask;
+}
+
+// per device sysfs attributes, read from the control page without locking
+static ssize_t size_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct int_stack_ctl snap;
+
+    read_ctl(dev_get_drvdata(dev), &snap);
+    return sysfs_emit(buf, "%u\n", snap.size);
+}
+static DEVICE_ATTR_RO(size);
+
+static ssize_t max_size_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct int_stack_ctl snap;
+
+    read_ctl(dev_get_drvdata(dev), &snap);
+    return sysfs_emit(buf, "%u\n", snap.max_size);
+}
+static DEVICE_ATTR_RO(max_size);
+
+static ssize_t high_water_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct int_stack_ctl snap;
+
+    read_ctl(dev_get_drvdata(dev), &snap);
+    return sysfs_emit(buf, "%u\n", snap.high_water);
+}
+static DEVICE_ATTR_RO(high_water);
+
+static ssize_t numa_node_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct int_stack *stack = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%d\n", stack->node);
+}
+static DEVICE_ATTR_RO(numa_node);
+
+// values currently held by the spill file
+static ssize_t spilled_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct int_stack *stack = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(stack->core.spilled) * STACK_CORE_CHUNK_INTS);
+}
+static DEVICE_ATTR_RO(spilled);
+
+// values the stack dropped from its bottom since it was created
+static ssize_t evicted_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct int_stack *stack = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%llu\n", READ_ONCE(stack->evicted));
+}
+static DEVICE_ATTR_RO(evicted);
+
+static struct attribute *int_stack_attrs[] = {
+    &dev_attr_size.attr,
+    &dev_attr_max_size.attr,
+    &dev_attr_high_water.attr,
+    &dev_attr_numa_node.attr,
+    &dev_attr_spilled.attr,
+    &dev_attr_evicted.attr,
+    NULL
+};
+ATTRIBUTE_GROUPS(int_stack);
+
+static void destroy_devices(unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        device_destroy(int_stack_device.class, MKDEV(MAJOR(int_stack_device.dev_number), i));
+    }
+}
+
+static int create_device(void)
+{
+    struct device *device;
+    unsigned int i;
+
+    if (int_stack_device.device_created) {
+        return 0;
+    }
+
+    for (i = 0; i < nr_devices; i++) {
+        // a single device keeps the historical /dev/int_stack name
+        if (nr_devices == 1) {
+            device = device_create(int_stack_device.class, NULL,
+                                   MKDEV(MAJOR(int_stack_device.dev_number), i), stacks[i],
+                                   DEVICE_NAME);
+        } else {
+            device = device_create(int_stack_device.class, NULL,
+                                   MKDEV(MAJOR(int_stack_device.dev_number), i), stacks[i],
+                                   DEVICE_NAME "%u", i);
+        }
+
+        if (IS_ERR(device)) {
+            pr_err("INT_STACK: Failed to create device\n");
+            destroy_devices(i);
+            return PTR_ERR(device);
+        }
+    }
+
+    int_stack_device.device_created = true;
+    pr_info("INT_STACK: %u device(s) created at /dev/%s*\n", nr_devices, DEVICE_NAME);
+    return 0;
+}
+
+static void remove_device(void)
+{
+    if (int_stack_device.device_created) {
+        destroy_devices(nr_devices);
+        int_stack_device.device_created = false;
+        pr_info("INT_STACK: Devices removed from /dev/%s*\n", DEVICE_NAME);
+    }
+}
+
+static int usb_key_probe(struct usb_interface *interface, const struct usb_device_id *id)
+{
+    struct usb_device *udev = interface_to_usbdev(interface);
+    
+    pr_info("INT_STACK: USB device with VID:PID %04x:%04x connected\n", 
+           udev->descriptor.idVendor, udev->descriptor.idProduct);
+    
+    usb_key_device = udev;
+    trace_int_stack_usb_attach(udev->descriptor.idVendor, udev->descriptor.idProduct);
+    
+    create_device();
+    
+    return 0;
+}
+
+static void usb_key_disconnect(struct usb_interface *interface)
+{
+    struct usb_device *udev = interface_to_usbdev(interface);
+
+    trace_int_stack_usb_detach(udev->descriptor.idVendor, udev->descriptor.idProduct);
+    usb_key_device = NULL;
+    
+    remove_device();
+    
+    pr_info("INT_STACK: USB key disconnected, device removed\n");
+}
+
+static struct usb_device_id usb_key_table[] = {
+    { USB_DEVICE(USB_KEY_VENDOR_ID, USB_KEY_PRODUCT_ID) },
+    { }
+};
+MODULE_DEVICE_TABLE(usb, usb_key_table);
+
+static struct usb_driver usb_key_driver = {
+    .name = "int_stack_key",
+    .id_table = usb_key_table,
+    .probe = usb_key_probe,
+    .disconnect = usb_key_disconnect,
+};
+
+static void stats_sum(struct int_stack_stats *sum)
+{
+    struct int_stack_stats *st;
+    unsigned int cpu, i;
+
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        st = per_cpu_ptr(&stack_stats, cpu);
+        sum->pushes += st->pushes;
+        sum->pops += st->pops;
+        sum->empty_reads += st->empty_reads;
+        sum->full_writes += st->full_writes;
+        sum->resizes += st->resizes;
+        sum->bytes_copied += st->bytes_copied;
+        sum->contended += st->contended;
+        sum->remote_ops += st->remote_ops;
+        sum->trimmed += st->trimmed;
+        sum->elim_hits += st->elim_hits;
+        sum->elim_misses += st->elim_misses;
+        sum->spills += st->spills;
+        sum->unspills += st->unspills;
+        sum->evicted += st->evicted;
+        sum->lost += st->lost;
+        for (i = 0; i < LAT_BUCKETS; i++) {
+            sum->push_lat[i] += st->push_lat[i];
+            sum->pop_lat[i] += st->pop_lat[i];
+        }
+    }
+}
+
+static int stats_show(struct seq_file *m, void *v)
+{
+    struct int_stack_stats sum;
+
+    stats_sum(&sum);
+    seq_printf(m, "pushes: %llu\n", sum.pushes);
+    seq_printf(m, "pops: %llu\n", sum.pops);
+    seq_printf(m, "empty_reads: %llu\n", sum.empty_reads);
+    seq_printf(m, "full_writes: %llu\n", sum.full_writes);
+    seq_printf(m, "resizes: %llu\n", sum.resizes);
+    seq_printf(m, "bytes_copied: %llu\n", sum.bytes_copied);
+    seq_printf(m, "contended: %llu\n", sum.contended);
+    seq_printf(m, "remote_ops: %llu\n", sum.remote_ops);
+    seq_printf(m, "trimmed: %llu\n", sum.trimmed);
+    seq_printf(m, "elim_hits: %llu\n", sum.elim_hits);
+    seq_printf(m, "elim_misses: %llu\n", sum.elim_misses);
+    seq_printf(m, "spills: %llu\n", sum.spills);
+    seq_printf(m, "unspills: %llu\n", sum.unspills);
+    seq_printf(m, "evicted: %llu\n", sum.evicted);
+    seq_printf(m, "lost: %llu\n", sum.lost);
+    // share of contended single value operations that skipped the lock, in percent
+    seq_printf(m, "elim_hit_rate: %llu\n",
+               div64_u64(100 * sum.elim_hits, max(sum.elim_hits + sum.elim_misses, 1ULL)));
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(stats);
+
+// one row per non-empty bucket, covering [2^i, 2^(i+1)) ns
+static int latency_show(struct seq_file *m, void *v)
+{
+    struct int_stack_stats sum;
+    unsigned int i;
+
+    stats_sum(&sum);
+    seq_printf(m, "%-12s %-12s %-12s\n", "ns", "push", "pop");
+    for (i = 0; i < LAT_BUCKETS; i++) {
+        if (sum.push_lat[i] || sum.pop_lat[i]) {
+            seq_printf(m, "%-12llu %-12llu %-12llu\n", 1ULL << i, sum.push_lat[i], sum.pop_lat[i]);
+        }
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(latency);
+
+// any write to the reset file zeroes all counters and histograms
+static ssize_t reset_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos)
+{
+    unsigned int cpu;
+
+    for_each_possible_cpu(cpu) {
+        memset(per_cpu_ptr(&stack_stats, cpu), 0, sizeof(struct int_stack_stats));
+    }
+
+    return count;
+}
+
+static const struct file_operations reset_fops = {
+    .write = reset_write,
+    .llseek = noop_llseek,
+    .owner = THIS_MODULE
+};
+
+static void init_debugfs(void)
+{
+    debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, debugfs_dir, NULL, &stats_fops);
+    debugfs_create_file("latency", 0444, debugfs_dir, NULL, &latency_fops);
+    debugfs_create_file("reset", 0200, debugfs_dir, NULL, &reset_fops);
+}
+
+// storage above the current size and the floor of every stack is reclaimable
+// reclaim never waits for the stack list, a busy list is skipped this round
+static unsigned long stack_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+    struct int_stack *s;
+    unsigned long count = 0;
+
+    if (!mutex_trylock(&stack_list_lock)) {
+        return 0;
+    }
+
+    list_for_each_entry(s, &stack_list, list) {
+        count += stack_core_trimmable(&s->core, trim_floor());
+    }
+
+    mutex_unlock(&stack_list_lock);
+    return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long stack_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+    struct int_stack *s;
+    unsigned long freed = 0;
+
+    if (!mutex_trylock(&stack_list_lock)) {
+        return SHRINK_STOP;
+    }
+
+    list_for_each_entry(s, &stack_list, list) {
+        if (freed >= sc->nr_to_scan) {
+            break;
+        }
+        freed += stack_core_trim(&s->core, trim_floor(),
+                                 min_t(unsigned long, sc->nr_to_scan - freed, UINT_MAX));
+    }
+
+    mutex_unlock(&stack_list_lock);
+    this_cpu_add(stack_stats.trimmed, freed);
+    return freed;
+}
+
+static int init_shrinker(void)
+{
+    stack_shrinker = shrinker_alloc(0, DEVICE_NAME);
+    if (!stack_shrinker) {
+        pr_err("INT_STACK: Failed to allocate shrinker\n");
+        return -ENOMEM;
+    }
+
+    stack_shrinker->count_objects = stack_shrink_count;
+    stack_shrinker->scan_objects = stack_shrink_scan;
+    // one object is a whole page sized chunk
+    stack_shrinker->seeks = DEFAULT_SEEKS;
+    shrinker_register(stack_shrinker);
+    return 0;
+}
+
+static void free_stack_data(void)
+{
+    unsigned int i;
+
+    if (stacks) {
+        for (i = 0; i < nr_devices; i++) {
+            free_stack(stacks[i]);
+        }
+        kfree(stacks);
+        stacks = NULL;
+    }
+}
+
+// numa_node pins every stack, otherwise devices go round robin over
+// online nodes so that each socket can get a stack of its own
+static int stack_node(unsigned int minor)
+{
+    int node = first_online_node;
+
+    if (stack_numa_node != NUMA_NO_NODE || nr_devices == 1) {
+        return stack_numa_node;
+    }
+
+    while (minor--) {
+        node = next_online_node(node);
+        if (node == MAX_NUMNODES) {
+            node = first_online_node;
+        }
+    }
+
+    return node;
+}
+
+static int init_stack_data(void)
+{
+    unsigned int i;
+
+    if (nr_devices == 0 || nr_devices > MAX_DEVICES) {
+        pr_err("INT_STACK: nr_devices should be within 1..%d\n", MAX_DEVICES);
+        return -EINVAL;
+    }
+
+    // bounds hold for the values below, evicting or spilling those breaks them
+    if (track_minmax && (record_mode || drop_oldest)) {
+        pr_err("INT_STACK: track_minmax goes with neither record_mode nor drop_oldest\n");
+        return -EINVAL;
+    }
+
+    if (stack_numa_node != NUMA_NO_NODE &&
+        (stack_numa_node < 0 || stack_numa_node >= MAX_NUMNODES ||
+         !node_online(stack_numa_node))) {
+        pr_err("INT_STACK: numa_node %d is not an online node\n", stack_numa_node);
+        return -EINVAL;
+    }
+
+    stacks = kcalloc(nr_devices, sizeof(struct int_stack *), GFP_KERNEL);
+    if (!stacks) {
+        pr_err("INT_STACK: Failed to allocate memory for stacks\n");
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < nr_devices; i++) {
+        stacks[i] = alloc_stack(stack_node(i));
+        if (!stacks[i]) {
+            pr_err("INT_STACK: Failed to allocate memory for stack\n");
+            free_stack_data();
+            return -ENOMEM;
+        }
+    }
+    
+    return 0;
+}
+
+static int init_char_device(void)
+{
+    int ret;
+    
+    // allocate a major/minor number for the device
+    ret = alloc_chrdev_region(&int_stack_device.dev_number, 0, nr_devices, DEVICE_NAME);
+    if (ret < 0) {
+        pr_err("INT_STACK: Failed to allocate device number\n");
+        return ret;
+    }
+
+    // create device class
+    int_stack_device.class = class_create(CLASS_NAME);
+    if (IS_ERR(int_stack_device.class)) {
+        pr_err("INT_STACK: Failed to create device class\n");
+        ret = PTR_ERR(int_stack_device.class);
+        unregister_chrdev_region(int_stack_device.dev_number, nr_devices);
+        return ret;
+    }
+    int_stack_device.class->dev_groups = int_stack_groups;
+
+    // initialize character device
+    cdev_init(&int_stack_device.cdev, &int_stack_fops);
+    int_stack_device.cdev.owner = THIS_MODULE;
+
+    // add character device to the system
+    ret = cdev_add(&int_stack_device.cdev, int_stack_device.dev_number, nr_devices);
+    if (ret < 0) {
+        pr_err("INT_STACK: Failed to add character device\n");
+        class_destroy(int_stack_device.class);
+        unregister_chrdev_region(int_stack_device.dev_number, nr_devices);
+        return ret;
+    }
+    
+    int_stack_device.device_created = false;
+    
+    return 0;
+}
+
+// initialisation
+static int __init int_stack_init(void)
+{
+    int ret;
+
+    ret = init_stack_data();
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = init_shrinker();
+    if (ret < 0) {
+        free_stack_data();
+        return ret;
+    }
+
+    ret = init_char_device();
+    if (ret < 0) {
+        shrinker_free(stack_shrinker);
+        free_stack_data();
+        return ret;
+    }
+
+    ret = usb_register(&usb_key_driver);
+    if (ret < 0) {
+        pr_err("INT_STACK: Failed to register USB driver\n");
+        cdev_del(&int_stack_device.cdev);
+        class_destroy(int_stack_device.class);
+        unregister_chrdev_region(int_stack_device.dev_number, nr_devices);
+        shrinker_free(stack_shrinker);
+        free_stack_data();
+        return ret;
+    }
+
+    init_debugfs();
+
+    pr_info("INT_STACK: Module loaded successfully\n");
+    pr_info("INT_STACK: Waiting for USB key with VID:PID %04x:%04x to be inserted\n", 
+            USB_KEY_VENDOR_ID, USB_KEY_PRODUCT_ID);
+
+    return 0;
+}
+
+// cleanup
+static void __exit int_stack_exit(void)
+{
+    usb_deregister(&usb_key_driver);
+    debugfs_remove_recursive(debugfs_dir);
+    
+    remove_device();
+    
+    cdev_del(&int_stack_device.cdev);
+    class_destroy(int_stack_device.class);
+    unregister_chrdev_region(int_stack_device.dev_number, nr_devices);
+    
+    shrinker_free(stack_shrinker);
+    free_stack_data();
+    
+    pr_info("INT_STACK: Module unloaded successfully\n");
+}
+
+module_init(int_stack_init);
+module_exit(int_stack_exit);
@@ -0,0 +1,130 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM int_stack
+
+#if !defined(_INT_STACK_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _INT_STACK_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/sched.h>
+
+// one event per batch, value is the one left on top for a push
+// and the first one handed out for a pop
+DECLARE_EVENT_CLASS(int_stack_op,
+    TP_PROTO(int value, unsigned int count, unsigned int size),
+    TP_ARGS(value, count, size),
+
+    TP_STRUCT__entry(
+        __field(int, value)
+        __field(unsigned int, count)
+        __field(unsigned int, size)
+        __field(pid_t, pid)
+    ),
+
+    TP_fast_assign(
+        __entry->value = value;
+        __entry->count = count;
+        __entry->size = size;
+        __entry->pid = current->pid;
+    ),
+
+    TP_printk("value=%d count=%u size=%u pid=%d",
+              __entry->value, __entry->count, __entry->size, __entry->pid)
+);
+
+DEFINE_EVENT(int_stack_op, int_stack_push,
+    TP_PROTO(int value, unsigned int count, unsigned int size),
+    TP_ARGS(value, count, size)
+);
+
+DEFINE_EVENT(int_stack_op, int_stack_pop,
+    TP_PROTO(int value, unsigned int count, unsigned int size),
+    TP_ARGS(value, count, size)
+);
+
+// read found the stack empty or write found it full
+DECLARE_EVENT_CLASS(int_stack_reject,
+    TP_PROTO(unsigned int size, unsigned int max_size),
+    TP_ARGS(size, max_size),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, size)
+        __field(unsigned int, max_size)
+        __field(pid_t, pid)
+    ),
+
+    TP_fast_assign(
+        __entry->size = size;
+        __entry->max_size = max_size;
+        __entry->pid = current->pid;
+    ),
+
+    TP_printk("size=%u max_size=%u pid=%d",
+              __entry->size, __entry->max_size, __entry->pid)
+);
+
+DEFINE_EVENT(int_stack_reject, int_stack_empty,
+    TP_PROTO(unsigned int size, unsigned int max_size),
+    TP_ARGS(size, max_size)
+);
+
+DEFINE_EVENT(int_stack_reject, int_stack_full,
+    TP_PROTO(unsigned int size, unsigned int max_size),
+    TP_ARGS(size, max_size)
+);
+
+TRACE_EVENT(int_stack_resize,
+    TP_PROTO(unsigned int old_max_size, unsigned int max_size, unsigned int size),
+    TP_ARGS(old_max_size, max_size, size),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, old_max_size)
+        __field(unsigned int, max_size)
+        __field(unsigned int, size)
+        __field(pid_t, pid)
+    ),
+
+    TP_fast_assign(
+        __entry->old_max_size = old_max_size;
+        __entry->max_size = max_size;
+        __entry->size = size;
+        __entry->pid = current->pid;
+    ),
+
+    TP_printk("old_max_size=%u max_size=%u size=%u pid=%d",
+              __entry->old_max_size, __entry->max_size, __entry->size, __entry->pid)
+);
+
+DECLARE_EVENT_CLASS(int_stack_usb,
+    TP_PROTO(u16 vendor, u16 product),
+    TP_ARGS(vendor, product),
+
+    TP_STRUCT__entry(
+        __field(u16, vendor)
+        __field(u16, product)
+    ),
+
+    TP_fast_assign(
+        __entry->vendor = vendor;
+        __entry->product = product;
+    ),
+
+    TP_printk("vid=%04x pid=%04x", __entry->vendor, __entry->product)
+);
+
+DEFINE_EVENT(int_stack_usb, int_stack_usb_attach,
+    TP_PROTO(u16 vendor, u16 product),
+    TP_ARGS(vendor, product)
+);
+
+DEFINE_EVENT(int_stack_usb, int_stack_usb_detach,
+    TP_PROTO(u16 vendor, u16 product),
+    TP_ARGS(vendor, product)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE int_stack_trace
+#include <trace/define_trace.h>
@@ -4,31 +4,58 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <errno.h>
+#include <stdint.h>
+
+#include "int_stack.h"
 
 #define DEVICE_PATH "/dev/int_stack"
 
-#define INT_STACK_MAGIC 'S'
-#define INT_STACK_SET_SIZE _IOW(INT_STACK_MAGIC, 1, unsigned int)
+// values grouped into one read or write in batch mode
+#define BATCH_SIZE 4096
+
+// values drained by one read in unwind
+#define UNWIND_CHUNK 16384
 
 void print_help(void);
 int set_size(int fd, int size);
 int push(int fd, int value);
 int pop(int fd, int *value);
-int unwind(int fd);
+int unwind(int fd, int binary);
+int peek(int fd, int count);
+int batch(int fd, FILE *in);
+int watch(int fd, int high, int low);
+int reduce(int fd, unsigned int count);
 
 int main(int argc, char *argv[]) {
-    int fd, ret = 0;
+    const char *device = DEVICE_PATH;
+    int fd, opt, ret = 0;
+
+    // options end at the command, so "push -5" keeps its value
+    while ((opt = getopt(argc, argv, "+d:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            device = optarg;
+            break;
+        default:
+            print_help();
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
     
     if (argc < 2) {
         print_help();
         return 1;
     }
 
-    fd = open(DEVICE_PATH, O_RDWR);
+    // the CLI never waits on the stack, empty and full are reported instead
+    fd = open(device, O_RDWR | O_NONBLOCK);
     if (fd < 0) {
         if (errno == ENOENT) {
-            fprintf(stderr, "error: USB key not inserted\n");
+            fprintf(stderr, "error: no %s, USB key not inserted or wrong device\n", device);
         } else {
             perror("Failed to open device");
         }
@@ -62,13 +89,60 @@ int main(int argc, char *argv[]) {
         int value;
         ret = pop(fd, &value);
     } 
+    else if (strcmp(argv[1], "peek") == 0) {
+        if (argc != 3) {
+            print_help();
+            close(fd);
+            return 1;
+        }
+        int count = atoi(argv[2]);
+        ret = peek(fd, count);
+    } 
+    else if (strcmp(argv[1], "batch") == 0) {
+        if (argc > 3) {
+            print_help();
+            close(fd);
+            return 1;
+        }
+        FILE *in = stdin;
+        if (argc == 3 && strcmp(argv[2], "-") != 0) {
+            in = fopen(argv[2], "r");
+            if (!in) {
+                perror("ERROR");
+                close(fd);
+                return 1;
+            }
+        }
+        ret = batch(fd, in);
+        if (in != stdin) {
+            fclose(in);
+        }
+    } 
+    else if (strcmp(argv[1], "watch") == 0) {
+        if (argc != 4) {
+            print_help();
+            close(fd);
+            return 1;
+        }
+        ret = watch(fd, atoi(argv[2]), atoi(argv[3]));
+    } 
+    else if (strcmp(argv[1], "reduce") == 0) {
+        if (argc > 3) {
+            print_help();
+            close(fd);
+            return 1;
+        }
+        unsigned int count = argc == 3 ? (unsigned int)atol(argv[2]) : UINT32_MAX;
+        ret = reduce(fd, count);
+    } 
     else if (strcmp(argv[1], "unwind") == 0) {
-        if (argc != 2) {
+        int binary = argc == 3 && strcmp(argv[2], "--binary") == 0;
+        if (argc != 2 && !binary) {
             print_help();
             close(fd);
             return 1;
         }
-        ret = unwind(fd);
+        ret = unwind(fd, binary);
     } 
     else {
         fprintf(stderr, "Unknown command: %s\n", argv[1]);
@@ -82,12 +156,21 @@ int main(int argc, char *argv[]) {
 }
 
 void print_help(void) {
-    printf("Usage: kernel_stack <command> [arguments]\n\n");
+    printf("Usage: kernel_stack [-d <path>] <command> [arguments]\n\n");
+    printf("\t-d <path>\tDevice to use (default %s), e.g. /dev/int_stack1 with nr_devices > 1\n\n",
+           DEVICE_PATH);
     printf("Commands:\n");
     printf("\tset-size <size>\tSet maximum size of the stack\n");
     printf("\tpush <value>\tPush integer value onto the stack\n");
     printf("\tpop\tPop integer from the stack\n");
-    printf("\tunwind\tPop all integers from the stack\n");
+    printf("\tpeek <count>\tShow up to count integers from the top without popping\n");
+    printf("\tunwind [--binary]\tPop all integers from the stack, --binary writes them packed\n");
+    printf("\tbatch [file]\tRun commands from file or stdin over one open device\n");
+    printf("\twatch <high> <low>\tPrint the size each time it rises to high or falls to low\n");
+    printf("\treduce [count]\tPrint count, sum, min and max of the top count integers, all by default\n");
+    printf("\nBatch input has one command per line: push <value>, pop, set-size <size>\n");
+    printf("or a bare integer, which is pushed. Consecutive pushes and pops are\n");
+    printf("grouped into single writes and reads.\n");
 }
 
 int set_size(int fd, int size) {
@@ -114,7 +197,7 @@ int push(int fd, int value) {
         return 0;
     }
 
-    if (errno == ERANGE) {
+    if (errno == EAGAIN || errno == ERANGE) {
         fprintf(stderr, "ERROR: stack is full\n");
     } else {
         perror("ERROR");
@@ -126,7 +209,7 @@ int push(int fd, int value) {
 int pop(int fd, int *value) {
     int ret = read(fd, value, sizeof(int));
     
-    if (ret == 0) {
+    if (ret == 0 || (ret < 0 && errno == EAGAIN)) {
         printf("NULL\n");
         return 0;
     } else if (ret < 0) {
@@ -139,22 +222,341 @@ int pop(int fd, int *value) {
     return 0;
 }
 
-int unwind(int fd) {
-    int value;
-    int ret;
+// writes value and a newline at p, returns position after them
+static char *format_int(char *p, int value) {
+    char digits[10];
+    unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+
+    if (value < 0) {
+        *p++ = '-';
+    }
+    while (n) {
+        *p++ = digits[--n];
+    }
+    *p++ = '\n';
+
+    return p;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len) {
+        ssize_t ret = write(fd, buf, len);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        buf += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+int unwind(int fd, int binary) {
+    // sign, 10 digits and a newline per value
+    static char text[UNWIND_CHUNK * 12];
+    static int values[UNWIND_CHUNK];
+    ssize_t ret;
     
+    fflush(stdout);
+
     while (1) {
-        ret = read(fd, &value, sizeof(int));
+        ret = read(fd, values, sizeof(values));
         
-        if (ret == 0) {  // stack is empty, finish execution
+        if (ret == 0 || (ret < 0 && errno == EAGAIN)) {  // stack is empty, finish execution
             break;
         } else if (ret < 0) {
             perror("ERROR");
             return -errno;
         }
 
-        printf("%d\n", value);
+        if (binary) {
+            ret = write_all(STDOUT_FILENO, (const char *)values, ret);
+        } else {
+            char *p = text;
+            for (int i = 0; i < ret / (ssize_t)sizeof(int); i++) {
+                p = format_int(p, values[i]);
+            }
+            ret = write_all(STDOUT_FILENO, text, p - text);
+        }
+
+        if (ret < 0) {
+            perror("ERROR");
+            return -errno;
+        }
     }
     
     return 0;
 }
+
+int peek(int fd, int count) {
+    if (count <= 0) {
+        fprintf(stderr, "ERROR: count should be > 0\n");
+        return 1;
+    }
+
+    int *values = malloc(sizeof(int) * count);
+    if (!values) {
+        perror("ERROR");
+        return -errno;
+    }
+
+    struct int_stack_peek req = {
+        .values = (__u64)(uintptr_t)values,
+        .count = (unsigned int)count,
+    };
+
+    if (ioctl(fd, INT_STACK_PEEK, &req) < 0) {
+        perror("ERROR");
+        free(values);
+        return -errno;
+    }
+
+    if (req.count == 0) {
+        printf("NULL\n");
+    }
+    for (unsigned int i = 0; i < req.count; i++) {
+        printf("%d\n", values[i]);
+    }
+
+    free(values);
+    return 0;
+}
+
+// writes all pending values, the device may accept only part of them per call
+static int flush_pushes(int fd, int *values, int *count) {
+    int done = 0;
+
+    while (done < *count) {
+        ssize_t ret = write(fd, values + done, sizeof(int) * (*count - done));
+
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == ERANGE) {
+                fprintf(stderr, "ERROR: stack is full, %d value(s) not pushed\n", *count - done);
+            } else {
+                perror("ERROR");
+            }
+            *count = 0;
+            return -errno;
+        }
+
+        done += ret / sizeof(int);
+    }
+
+    *count = 0;
+    return 0;
+}
+
+// pops pending values with as few reads as possible, NULL for each missing one
+static int flush_pops(int fd, int *count) {
+    int values[BATCH_SIZE];
+    int done = 0;
+
+    while (done < *count) {
+        ssize_t ret = read(fd, values, sizeof(int) * (*count - done));
+
+        if (ret == 0 || (ret < 0 && errno == EAGAIN)) {  // stack is empty
+            break;
+        } else if (ret < 0) {
+            perror("ERROR");
+            *count = 0;
+            return -errno;
+        }
+
+        for (int i = 0; i < ret / (ssize_t)sizeof(int); i++) {
+            printf("%d\n", values[i]);
+        }
+        done += ret / sizeof(int);
+    }
+
+    for (; done < *count; done++) {
+        printf("NULL\n");
+    }
+
+    *count = 0;
+    return 0;
+}
+
+static int parse_int(const char *s, int *value) {
+    char *end;
+
+    errno = 0;
+    long v = strtol(s, &end, 10);
+    if (errno || end == s || v < INT32_MIN || v > INT32_MAX) {
+        return -1;
+    }
+
+    while (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r') {
+        end++;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+
+    *value = (int)v;
+    return 0;
+}
+
+int batch(int fd, FILE *in) {
+    int pushes[BATCH_SIZE];
+    int npush = 0, npop = 0;
+    char line[256];
+    int lineno = 0;
+    int value, ret = 0;
+
+    while (ret == 0 && fgets(line, sizeof(line), in)) {
+        char *cmd = line + strspn(line, " \t");
+        lineno++;
+
+        if (*cmd == '\n' || *cmd == '\0' || *cmd == '#') {
+            continue;
+        }
+
+        if (strncmp(cmd, "push", 4) == 0 || parse_int(cmd, &value) == 0) {
+            if (strncmp(cmd, "push", 4) == 0 && parse_int(cmd + 4, &value) < 0) {
+                fprintf(stderr, "ERROR: line %d: bad value\n", lineno);
+                ret = 1;
+                break;
+            }
+            if (npop) {
+                ret = flush_pops(fd, &npop);
+            }
+            pushes[npush++] = value;
+            if (ret == 0 && npush == BATCH_SIZE) {
+                ret = flush_pushes(fd, pushes, &npush);
+            }
+        } else if (strncmp(cmd, "pop", 3) == 0 && strspn(cmd + 3, " \t\r\n") == strlen(cmd + 3)) {
+            if (npush) {
+                ret = flush_pushes(fd, pushes, &npush);
+            }
+            npop++;
+            if (ret == 0 && npop == BATCH_SIZE) {
+                ret = flush_pops(fd, &npop);
+            }
+        } else if (strncmp(cmd, "set-size", 8) == 0) {
+            if (parse_int(cmd + 8, &value) < 0) {
+                fprintf(stderr, "ERROR: line %d: bad size\n", lineno);
+                ret = 1;
+                break;
+            }
+            if (npush) {
+                ret = flush_pushes(fd, pushes, &npush);
+            }
+            if (npop) {
+                ret = flush_pops(fd, &npop);
+            }
+            if (ret == 0) {
+                ret = set_size(fd, value);
+            }
+        } else {
+            fprintf(stderr, "ERROR: line %d: unknown command: %s", lineno, cmd);
+            ret = 1;
+        }
+    }
+
+    if (ret == 0 && npush) {
+        ret = flush_pushes(fd, pushes, &npush);
+    }
+    if (ret == 0 && npop) {
+        ret = flush_pops(fd, &npop);
+    }
+
+    return ret;
+}
+
+int watch(int fd, int high, int low) {
+    struct int_stack_watermarks wm;
+    struct int_stack_ctl ctl;
+    uint64_t crossings;
+    int efd, above;
+
+    if (low < 0 || high <= low) {
+        fprintf(stderr, "ERROR: watermarks should be 0 <= low < high\n");
+        return 1;
+    }
+
+    efd = eventfd(0, 0);
+    if (efd < 0) {
+        perror("ERROR");
+        return -errno;
+    }
+
+    wm = (struct int_stack_watermarks){ .eventfd = efd, .high = high, .low = low };
+    if (ioctl(fd, INT_STACK_SET_WATERMARKS, &wm) < 0 || ioctl(fd, INT_STACK_GET_STATS, &ctl) < 0) {
+        perror("ERROR");
+        close(efd);
+        return -errno;
+    }
+
+    // crossings alternate, the first one goes the other way from where the stack is now
+    above = ctl.size >= (unsigned int)high;
+
+    while (read(efd, &crossings, sizeof(crossings)) == sizeof(crossings)) {
+        if (ioctl(fd, INT_STACK_GET_STATS, &ctl) < 0) {
+            perror("ERROR");
+            break;
+        }
+
+        above ^= crossings & 1;
+        printf("%s %u\n", above ? "high" : "low", ctl.size);
+        fflush(stdout);
+    }
+
+    close(efd);
+    return -errno;
+}
+
+// the kernel reduces a bounded number of values per call, so larger
+// counts are covered piece by piece further down the stack
+int reduce(int fd, unsigned int count) {
+    struct int_stack_reduce req;
+    unsigned int done = 0, size = 0;
+    long long sum = 0;
+    int min = 0, max = 0;
+
+    while (done < count) {
+        memset(&req, 0, sizeof(req));
+        req.skip = done;
+        req.count = count - done;
+
+        if (ioctl(fd, INT_STACK_REDUCE, &req) < 0) {
+            perror("ERROR");
+            return -errno;
+        }
+        size = req.size;
+        if (req.count == 0) {
+            break;
+        }
+
+        if (done == 0 || req.min < min) {
+            min = req.min;
+        }
+        if (done == 0 || req.max > max) {
+            max = req.max;
+        }
+        sum += req.sum;
+        done += req.count;
+    }
+
+    if (done == 0) {
+        printf("NULL\n");
+        return 0;
+    }
+
+    printf("count %u\nsum %lld\nmin %d\nmax %d\n", done, sum, min, max);
+    // spilled values are counted in the size but never reduced
+    if (done < count && done < size) {
+        fprintf(stderr, "WARNING: %u values spilled out of memory are not included\n", size - done);
+    }
+    return 0;
+}
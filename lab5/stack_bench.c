@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "int_stack.h"
+
+#define DEVICE_PATH "/dev/int_stack"
+#define MAX_THREAD_COUNTS 32
+
+struct bench_config {
+    const char *device;
+    int thread_counts[MAX_THREAD_COUNTS];
+    int nr_thread_counts;
+    int push_pct;       // share of operations that are pushes
+    int batch;          // values per read or write
+    unsigned int stack_size;
+    long ops;           // operations per thread
+    int csv;
+};
+
+struct bench_thread {
+    pthread_t thread;
+    const struct bench_config *cfg;
+    int id;
+    uint64_t *lat;      // latency of every operation, ns
+    long values;        // values actually moved
+    long empty;         // pops that found the stack empty
+    long full;          // pushes that found the stack full
+    int error;
+};
+
+static pthread_barrier_t start_barrier;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t xorshift32(uint32_t *state) {
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void *bench_worker(void *arg) {
+    struct bench_thread *t = arg;
+    const struct bench_config *cfg = t->cfg;
+    uint32_t seed = 2463534242u + t->id * 7919u;
+    int *buf;
+    int fd;
+
+    buf = malloc(sizeof(int) * cfg->batch);
+    fd = open(cfg->device, O_RDWR | O_NONBLOCK);
+    if (!buf || fd < 0) {
+        t->error = errno;
+        pthread_barrier_wait(&start_barrier);
+        free(buf);
+        return NULL;
+    }
+
+    for (int i = 0; i < cfg->batch; i++) {
+        buf[i] = t->id * cfg->batch + i;
+    }
+
+    pthread_barrier_wait(&start_barrier);
+
+    for (long i = 0; i < cfg->ops; i++) {
+        int is_push = (int)(xorshift32(&seed) % 100) < cfg->push_pct;
+        uint64_t start = now_ns();
+        ssize_t ret;
+
+        if (is_push) {
+            ret = write(fd, buf, sizeof(int) * cfg->batch);
+        } else {
+            ret = read(fd, buf, sizeof(int) * cfg->batch);
+        }
+
+        t->lat[i] = now_ns() - start;
+
+        if (ret > 0) {
+            t->values += ret / sizeof(int);
+        } else if (ret == 0 || errno == EAGAIN || errno == ERANGE) {
+            if (is_push) {
+                t->full++;
+            } else {
+                t->empty++;
+            }
+        } else {
+            t->error = errno;
+            break;
+        }
+    }
+
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p) {
+    size_t idx = (size_t)(p * (n - 1));
+
+    return n ? sorted[idx] : 0;
+}
+
+// empties the stack so every run starts from the same state
+static int reset_stack(const struct bench_config *cfg) {
+    static int drain[4096];
+    int fd = open(cfg->device, O_RDWR | O_NONBLOCK);
+
+    if (fd < 0) {
+        perror("Failed to open device");
+        return -1;
+    }
+
+    if (ioctl(fd, INT_STACK_SET_SIZE, &cfg->stack_size) < 0) {
+        perror("ERROR: set-size");
+        close(fd);
+        return -1;
+    }
+
+    while (read(fd, drain, sizeof(drain)) > 0) {
+    }
+
+    close(fd);
+    return 0;
+}
+
+static int run(const struct bench_config *cfg, int nr_threads) {
+    struct bench_thread *threads;
+    uint64_t *all_lat;
+    long values = 0, empty = 0, full = 0;
+    size_t total = (size_t)nr_threads * cfg->ops;
+    uint64_t start, elapsed;
+    int ret = 0;
+
+    if (reset_stack(cfg) < 0) {
+        return -1;
+    }
+
+    threads = calloc(nr_threads, sizeof(*threads));
+    all_lat = malloc(sizeof(uint64_t) * total);
+    if (!threads || !all_lat) {
+        perror("ERROR");
+        free(threads);
+        free(all_lat);
+        return -1;
+    }
+
+    pthread_barrier_init(&start_barrier, NULL, nr_threads + 1);
+
+    for (int i = 0; i < nr_threads; i++) {
+        threads[i].cfg = cfg;
+        threads[i].id = i;
+        threads[i].lat = all_lat + (size_t)i * cfg->ops;
+        ret = pthread_create(&threads[i].thread, NULL, bench_worker, &threads[i]);
+        if (ret != 0) {
+            // threads already started wait on the barrier for good, only
+            // ending the process gets them out
+            fprintf(stderr, "ERROR: creating thread %d: %s\n", i, strerror(ret));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    start = now_ns();
+
+    for (int i = 0; i < nr_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        values += threads[i].values;
+        empty += threads[i].empty;
+        full += threads[i].full;
+        if (threads[i].error) {
+            fprintf(stderr, "ERROR: thread %d: %s\n", i, strerror(threads[i].error));
+            ret = -1;
+        }
+    }
+
+    elapsed = now_ns() - start;
+    pthread_barrier_destroy(&start_barrier);
+
+    if (ret == 0) {
+        double secs = elapsed / 1e9;
+
+        qsort(all_lat, total, sizeof(uint64_t), cmp_u64);
+
+        if (cfg->csv) {
+            printf("%d,%d,%d,%u,%zu,%ld,%.6f,%.0f,%.0f,%llu,%llu,%llu,%ld,%ld\n",
+                   nr_threads, cfg->push_pct, cfg->batch, cfg->stack_size, total, values, secs,
+                   total / secs, values / secs,
+                   (unsigned long long)percentile(all_lat, total, 0.50),
+                   (unsigned long long)percentile(all_lat, total, 0.99),
+                   (unsigned long long)percentile(all_lat, total, 0.999),
+                   empty, full);
+        } else {
+            printf("%7d %12.0f %12.0f %10llu %10llu %10llu %10ld %10ld\n",
+                   nr_threads, total / secs, values / secs,
+                   (unsigned long long)percentile(all_lat, total, 0.50),
+                   (unsigned long long)percentile(all_lat, total, 0.99),
+                   (unsigned long long)percentile(all_lat, total, 0.999),
+                   empty, full);
+        }
+    }
+
+    free(threads);
+    free(all_lat);
+    return ret;
+}
+
+static void print_help(void) {
+    printf("Usage: stack_bench [options]\n\n");
+    printf("Options:\n");
+    printf("\t-d <path>\tDevice to benchmark (default %s)\n", DEVICE_PATH);
+    printf("\t-t <n,n,...>\tThread counts to run, one run per count (default 1,2,4,8)\n");
+    printf("\t-m <percent>\tShare of operations that are pushes (default 50)\n");
+    printf("\t-b <values>\tValues per read or write (default 1)\n");
+    printf("\t-s <size>\tStack max size set before every run (default 1048576)\n");
+    printf("\t-n <ops>\tOperations per thread (default 100000)\n");
+    printf("\t-c\t\tPrint CSV instead of a table\n");
+}
+
+static int parse_thread_counts(struct bench_config *cfg, char *list) {
+    char *tok;
+
+    cfg->nr_thread_counts = 0;
+    for (tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        int n = atoi(tok);
+
+        if (n <= 0 || cfg->nr_thread_counts == MAX_THREAD_COUNTS) {
+            return -1;
+        }
+        cfg->thread_counts[cfg->nr_thread_counts++] = n;
+    }
+
+    return cfg->nr_thread_counts ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    struct bench_config cfg = {
+        .device = DEVICE_PATH,
+        .thread_counts = { 1, 2, 4, 8 },
+        .nr_thread_counts = 4,
+        .push_pct = 50,
+        .batch = 1,
+        .stack_size = 1 << 20,
+        .ops = 100000,
+        .csv = 0,
+    };
+    int opt, ret = 0;
+
+    while ((opt = getopt(argc, argv, "d:t:m:b:s:n:ch")) != -1) {
+        switch (opt) {
+        case 'd':
+            cfg.device = optarg;
+            break;
+        case 't':
+            if (parse_thread_counts(&cfg, optarg) < 0) {
+                fprintf(stderr, "ERROR: bad thread count list\n");
+                return 1;
+            }
+            break;
+        case 'm':
+            cfg.push_pct = atoi(optarg);
+            break;
+        case 'b':
+            cfg.batch = atoi(optarg);
+            break;
+        case 's':
+            cfg.stack_size = (unsigned int)atol(optarg);
+            break;
+        case 'n':
+            cfg.ops = atol(optarg);
+            break;
+        case 'c':
+            cfg.csv = 1;
+            break;
+        default:
+            print_help();
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (cfg.push_pct < 0 || cfg.push_pct > 100 || cfg.batch <= 0 ||
+        cfg.stack_size == 0 || cfg.ops <= 0) {
+        print_help();
+        return 1;
+    }
+
+    if (cfg.csv) {
+        printf("threads,push_pct,batch,stack_size,ops,values,seconds,"
+               "ops_per_sec,values_per_sec,p50_ns,p99_ns,p999_ns,empty,full\n");
+    } else {
+        printf("push %d%%, batch %d, stack size %u, %ld ops per thread\n\n",
+               cfg.push_pct, cfg.batch, cfg.stack_size, cfg.ops);
+        printf("%7s %12s %12s %10s %10s %10s %10s %10s\n",
+               "threads", "ops/s", "values/s", "p50 ns", "p99 ns", "p999 ns", "empty", "full");
+    }
+
+    for (int i = 0; i < cfg.nr_thread_counts && ret == 0; i++) {
+        ret = run(&cfg, cfg.thread_counts[i]);
+    }
+
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,875 @@
+#include "stack_core.h"
+
+#define CHUNK_INTS STACK_CORE_CHUNK_INTS
+
+static inline void notify(struct stack_core *core, enum stack_core_event event,
+                          unsigned int count, int value)
+{
+    if (core->hook) {
+        core->hook(core, event, count, value);
+    }
+}
+
+static inline void core_lock(struct stack_core *core)
+{
+    if (!stack_core_trylock(&core->lock)) {
+        stack_core_lock_raw(&core->lock);
+        notify(core, STACK_CORE_CONTENDED, 0, 0);
+    }
+}
+
+// elimination slot states, the offered value sits in the low 32 bits
+#define ELIM_EMPTY 0LL
+#define ELIM_OFFER (1LL << 32)
+#define ELIM_TAKEN (2LL << 32)
+#define ELIM_STATE(v) ((v) & ~0xffffffffLL)
+
+// rounds an offer waits for a pop before taking the lock after all
+#define ELIM_SPINS 64
+
+// offers value in the slot of this CPU, true if a pop took it
+static bool elim_push(struct stack_core *core, int value)
+{
+    unsigned int hint = stack_core_cpu_hint();
+    stack_core_atomic64_t *slot = &core->elim[hint % STACK_CORE_ELIM_SLOTS];
+    long long offer = ELIM_OFFER | (unsigned int)value;
+    int i;
+
+    // only the pusher that filled a slot empties it again
+    if (stack_core_atomic64_cmpxchg(slot, ELIM_EMPTY, offer) != ELIM_EMPTY) {
+        return false;
+    }
+
+    for (i = 0; i < ELIM_SPINS; i++) {
+        if (stack_core_atomic64_read(slot) == ELIM_TAKEN) {
+            goto taken;
+        }
+        stack_core_relax();
+    }
+
+    // withdrawing, unless a pop took the value in the meantime
+    if (stack_core_atomic64_cmpxchg(slot, offer, ELIM_EMPTY) == offer) {
+        return false;
+    }
+
+taken:
+    stack_core_atomic64_set(slot, ELIM_EMPTY);
+    return true;
+}
+
+// takes any offered value, true if one was taken into out
+static bool elim_pop(struct stack_core *core, int *out)
+{
+    long long v;
+    int i;
+
+    for (i = 0; i < STACK_CORE_ELIM_SLOTS; i++) {
+        v = stack_core_atomic64_read(&core->elim[i]);
+        if (ELIM_STATE(v) == ELIM_OFFER &&
+            stack_core_atomic64_cmpxchg(&core->elim[i], v, ELIM_TAKEN) == v) {
+            *out = (int)(unsigned int)v;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// a single value operation that would wait for the lock tries elimination
+// first, false means it did not work out and the lock is held
+static bool core_lock_or_eliminate(struct stack_core *core, int *value, bool push)
+{
+    bool hit;
+
+    if (!core->elimination) {
+        core_lock(core);
+        return false;
+    }
+
+    if (stack_core_trylock(&core->lock)) {
+        return false;
+    }
+
+    hit = push ? elim_push(core, *value) : elim_pop(core, value);
+    notify(core, hit ? STACK_CORE_ELIM_HIT : STACK_CORE_ELIM_MISS, 1, hit ? *value : 0);
+    if (hit) {
+        return true;
+    }
+
+    stack_core_lock_raw(&core->lock);
+    notify(core, STACK_CORE_CONTENDED, 0, 0);
+    return false;
+}
+
+static inline void core_unlock(struct stack_core *core)
+{
+    stack_core_unlock(&core->lock);
+}
+
+// position in the chunks of the value pos places above the bottom,
+// a drop_oldest ring wraps at the end of its last chunk, which may lie
+// past max_size, so resizing can move whole chunks instead of values
+static inline unsigned int core_phys(struct stack_core *core, unsigned int pos)
+{
+    unsigned int ring = core->nr_chunks * CHUNK_INTS;
+
+    pos += core->base;
+    return pos >= ring ? pos - ring : pos;
+}
+
+// directory entry of the chunk-th chunk from the bottom, the directory
+// wraps like a ring once spills moved first away from 0
+static inline unsigned int core_dir(struct stack_core *core, unsigned int chunk)
+{
+    chunk += core->first;
+    return chunk >= core->nr_chunks ? chunk - core->nr_chunks : chunk;
+}
+
+static inline int *core_phys_slot(struct stack_core *core, unsigned int phys)
+{
+    return &core->chunks[core_dir(core, phys / CHUNK_INTS)][phys % CHUNK_INTS];
+}
+
+static inline int *core_slot(struct stack_core *core, unsigned int pos)
+{
+    return core_phys_slot(core, core_phys(core, pos));
+}
+
+// bounds are only tracked without drop_oldest, so base is 0 here
+static inline struct stack_core_bounds *core_bounds(struct stack_core *core, unsigned int pos)
+{
+    return &core->bounds[pos / CHUNK_INTS][pos % CHUNK_INTS];
+}
+
+// positions from pos upwards that are adjacent in memory, up to the end
+// of the chunk, where the ring also wraps
+static inline unsigned int core_run(struct stack_core *core, unsigned int pos)
+{
+    return CHUNK_INTS - core_phys(core, pos) % CHUNK_INTS;
+}
+
+// number of positions that can take a value without allocating
+// chunks are populated in order from the one holding the bottom, which
+// is the first one unless a ring wrapped, and trim leaves all of them
+// while base is away from 0
+static unsigned int core_backed(struct stack_core *core)
+{
+    if (core->populated == core->nr_chunks) {
+        return core->max_size;
+    }
+
+    return core->populated * CHUNK_INTS - core->base;
+}
+
+// copies n values into positions starting at pos, chunk by chunk
+static void copy_in(struct stack_core *core, unsigned int pos, const int *values, unsigned int n)
+{
+    unsigned int k;
+
+    while (n) {
+        k = min(n, core_run(core, pos));
+        memcpy(core_slot(core, pos), values, k * sizeof(int));
+        pos += k;
+        values += k;
+        n -= k;
+    }
+}
+
+// extends the bounds of the values below pos over n values just copied in
+static void bounds_in(struct stack_core *core, unsigned int pos, unsigned int n)
+{
+    struct stack_core_bounds b = { INT_MAX, INT_MIN };
+    int v;
+
+    if (pos) {
+        b = *core_bounds(core, pos - 1);
+    }
+
+    for (; n; n--, pos++) {
+        v = *core_slot(core, pos);
+        b.min = min(b.min, v);
+        b.max = max(b.max, v);
+        *core_bounds(core, pos) = b;
+    }
+}
+
+// copies n values below top into out, topmost first
+static void copy_out(struct stack_core *core, unsigned int top, int *out, unsigned int n)
+{
+    unsigned int i, k;
+    int *src;
+
+    // the ring wraps at position 0, which is a chunk boundary anyway
+    while (n) {
+        k = min(n, core_phys(core, top - 1) % CHUNK_INTS + 1);
+        src = core_slot(core, top - 1);
+        for (i = 0; i < k; i++) {
+            out[i] = *(src - i);
+        }
+        top -= k;
+        out += k;
+        n -= k;
+    }
+}
+
+// copies len bytes into positions starting at pos, the tail of the
+// last int is zeroed so no stale chunk contents stay next to a record
+static void copy_bytes_in(struct stack_core *core, unsigned int pos, const void *data,
+                          unsigned int len)
+{
+    const char *src = data;
+    unsigned int k;
+    int tail = 0;
+
+    while (len >= sizeof(int)) {
+        k = min(len / (unsigned int)sizeof(int), core_run(core, pos));
+        memcpy(core_slot(core, pos), src, k * sizeof(int));
+        pos += k;
+        src += k * sizeof(int);
+        len -= k * sizeof(int);
+    }
+
+    if (len) {
+        memcpy(&tail, src, len);
+        *core_slot(core, pos) = tail;
+    }
+}
+
+// copies len bytes from positions starting at pos into out
+static void copy_bytes_out(struct stack_core *core, unsigned int pos, void *out, unsigned int len)
+{
+    char *dst = out;
+    unsigned int k;
+
+    while (len) {
+        k = min(len, core_run(core, pos) * (unsigned int)sizeof(int));
+        memcpy(dst, core_slot(core, pos), k);
+        pos += DIV_ROUND_UP(k, sizeof(int));
+        dst += k;
+        len -= k;
+    }
+}
+
+// allocates the next chunk, and its bounds if tracked, without the lock held
+static int core_grow(struct stack_core *core)
+{
+    struct stack_core_bounds *bounds = NULL;
+    int *chunk;
+
+    chunk = stack_core_alloc(CHUNK_INTS * sizeof(int), core->node);
+    if (core->bounds) {
+        bounds = stack_core_alloc(CHUNK_INTS * sizeof(*bounds), core->node);
+    }
+    if (!chunk || (core->bounds && !bounds)) {
+        stack_core_free(chunk);
+        stack_core_free(bounds);
+        return -ENOMEM;
+    }
+
+    core_lock(core);
+    if (core->populated < core->nr_chunks) {
+        // bounds are never spilled, so first is 0 for them
+        if (bounds) {
+            core->bounds[core->populated] = bounds;
+            bounds = NULL;
+        }
+        core->chunks[core_dir(core, core->populated++)] = chunk;
+        chunk = NULL;
+    }
+    core_unlock(core);
+
+    // another pusher or a resize got there first
+    stack_core_free(chunk);
+    stack_core_free(bounds);
+    return 0;
+}
+
+int stack_core_init(struct stack_core *core, unsigned int max_size, stack_core_hook_t hook,
+                    int node)
+{
+    unsigned int i;
+
+    if (max_size > STACK_CORE_MAX_INTS) {
+        return -EINVAL;
+    }
+
+    core->size = 0;
+    core->max_size = max_size;
+    core->hook = hook;
+    core->records = false;
+    core->node = node;
+    core->spilled = 0;
+    core->elimination = false;
+    core->drop_oldest = false;
+    core->base = 0;
+    core->bounds = NULL;
+    for (i = 0; i < STACK_CORE_ELIM_SLOTS; i++) {
+        stack_core_atomic64_set(&core->elim[i], ELIM_EMPTY);
+    }
+
+    // chunks themselves are allocated on first push into them
+    core->populated = 0;
+    core->first = 0;
+    core->nr_chunks = DIV_ROUND_UP(max_size, CHUNK_INTS);
+    core->chunks = stack_core_calloc(core->nr_chunks, sizeof(int *), node);
+    if (!core->chunks) {
+        return -ENOMEM;
+    }
+
+    stack_core_lock_init(&core->lock);
+    return 0;
+}
+
+int stack_core_init_records(struct stack_core *core, unsigned int max_size, stack_core_hook_t hook,
+                            int node)
+{
+    int ret = stack_core_init(core, max_size, hook, node);
+
+    core->records = true;
+    return ret;
+}
+
+int stack_core_track_bounds(struct stack_core *core)
+{
+    if (core->records || core->drop_oldest || core->populated) {
+        return -EINVAL;
+    }
+
+    core->bounds = stack_core_calloc(core->nr_chunks, sizeof(*core->bounds), core->node);
+    return core->bounds ? 0 : -ENOMEM;
+}
+
+void stack_core_destroy(struct stack_core *core)
+{
+    unsigned int i;
+
+    for (i = 0; i < core->populated; i++) {
+        stack_core_free(core->chunks[core_dir(core, i)]);
+        if (core->bounds) {
+            stack_core_free(core->bounds[i]);
+        }
+    }
+    stack_core_free(core->chunks);
+    stack_core_free(core->bounds);
+    core->chunks = NULL;
+    core->bounds = NULL;
+    stack_core_lock_destroy(&core->lock);
+}
+
+static int core_push(struct stack_core *core, const int *values, unsigned int n, bool evict)
+{
+    unsigned int done = 0, evicted = 0, k;
+    int ret = -ERANGE;
+    int value;
+
+    if (n == 1) {
+        value = values[0];
+        if (core_lock_or_eliminate(core, &value, true)) {
+            return 1;
+        }
+    } else {
+        core_lock(core);
+    }
+
+    while (done < n) {
+        if (core->size == core->max_size) {
+            if (!evict || core->max_size == 0) {
+                break;
+            }
+
+            // evicting as much as the rest of the batch needs at once,
+            // the bottom moves up and the ring wraps, nothing is copied
+            k = min(n - done, core->size);
+            core->base = core_phys(core, k);
+            core->size -= k;
+            evicted += k;
+            continue;
+        }
+
+        k = min(n - done, core_backed(core) - core->size);
+        if (k == 0) {
+            // the lock is dropped while allocating, so a batch crossing
+            // into a new chunk may interleave with other pushers
+            core_unlock(core);
+            ret = core_grow(core);
+            core_lock(core);
+            if (ret < 0) {
+                break;
+            }
+            // other pushers may fill the stack while the lock was dropped
+            ret = -ERANGE;
+            continue;
+        }
+
+        copy_in(core, core->size, values + done, k);
+        if (core->bounds) {
+            bounds_in(core, core->size, k);
+        }
+        core->size += k;
+        done += k;
+    }
+
+    if (evicted) {
+        notify(core, STACK_CORE_EVICT, evicted, 0);
+    }
+    if (done) {
+        notify(core, STACK_CORE_PUSH, done, values[done - 1]);
+        ret = done;
+    }
+
+    core_unlock(core);
+    return ret;
+}
+
+int stack_core_push(struct stack_core *core, const int *values, unsigned int n)
+{
+    return core_push(core, values, n, core->drop_oldest);
+}
+
+int stack_core_push_back(struct stack_core *core, const int *values, unsigned int n)
+{
+    return core_push(core, values, n, false);
+}
+
+unsigned int stack_core_pop(struct stack_core *core, int *out, unsigned int n)
+{
+    if (n == 1) {
+        if (core_lock_or_eliminate(core, out, false)) {
+            return 1;
+        }
+    } else {
+        core_lock(core);
+    }
+
+    n = min(n, core->size);
+    copy_out(core, core->size, out, n);
+    core->size -= n;
+    if (core->size == 0) {
+        // an empty ring starts over at the first chunk, so trim can free the rest
+        core->base = 0;
+    }
+    if (n) {
+        notify(core, STACK_CORE_POP, n, out[0]);
+    }
+
+    core_unlock(core);
+    return n;
+}
+
+int stack_core_push_record(struct stack_core *core, const void *data, unsigned int len)
+{
+    unsigned int ints = stack_core_record_ints(len);
+    int ret;
+
+    // an empty record would read back like an empty stack
+    if (len == 0) {
+        return -EINVAL;
+    }
+
+    core_lock(core);
+
+    for (;;) {
+        if (ints > core->max_size) {
+            ret = -EMSGSIZE;
+            goto out;
+        }
+        if (ints > core->max_size - core->size) {
+            ret = -ERANGE;
+            goto out;
+        }
+        if (core->size + ints <= core_backed(core)) {
+            break;
+        }
+
+        // nothing is copied before all chunks are in place, so a record
+        // never interleaves with other pushers
+        core_unlock(core);
+        ret = core_grow(core);
+        core_lock(core);
+        if (ret < 0) {
+            goto out;
+        }
+    }
+
+    copy_bytes_in(core, core->size, data, len);
+    *core_slot(core, core->size + ints - 1) = len;
+    core->size += ints;
+    notify(core, STACK_CORE_PUSH, 1, len);
+    ret = len;
+
+out:
+    core_unlock(core);
+    return ret;
+}
+
+unsigned int stack_core_pop_record(struct stack_core *core, void *out, unsigned int cap)
+{
+    unsigned int len = 0, ints;
+
+    core_lock(core);
+
+    if (core->size == 0) {
+        goto out;
+    }
+
+    len = *core_slot(core, core->size - 1);
+    if (len > cap) {
+        goto out;
+    }
+
+    ints = stack_core_record_ints(len);
+    copy_bytes_out(core, core->size - ints, out, len);
+    core->size -= ints;
+    notify(core, STACK_CORE_POP, 1, len);
+
+out:
+    core_unlock(core);
+    return len;
+}
+
+// values on the stack, those spilled included
+static inline unsigned int core_total(struct stack_core *core)
+{
+    return core->size + core->spilled * CHUNK_INTS;
+}
+
+unsigned int stack_core_peek(struct stack_core *core, int *out, unsigned int n, unsigned int *size)
+{
+    core_lock(core);
+
+    n = min(n, core->size);
+    copy_out(core, core->size, out, n);
+    *size = core_total(core);
+
+    core_unlock(core);
+    return n;
+}
+
+int *stack_core_spill(struct stack_core *core)
+{
+    int *chunk = NULL;
+
+    core_lock(core);
+
+    // a ring has no fixed bottom chunk to take away, and bounds would
+    // have to leave with it
+    if (core->size >= CHUNK_INTS && !core->drop_oldest && !core->bounds) {
+        // the next directory entry becomes the bottom, no value moves
+        chunk = core->chunks[core->first];
+        core->chunks[core->first] = NULL;
+        core->first = core_dir(core, 1);
+        core->populated--;
+        core->size -= CHUNK_INTS;
+        core->spilled++;
+        notify(core, STACK_CORE_SPILL, CHUNK_INTS, 0);
+    }
+
+    core_unlock(core);
+    return chunk;
+}
+
+int stack_core_unspill(struct stack_core *core, int *chunk)
+{
+    int *spare = NULL;
+    int ret = 0;
+
+    core_lock(core);
+
+    if (core->spilled == 0 || core->size + CHUNK_INTS > core->max_size) {
+        ret = -ERANGE;
+        goto out;
+    }
+
+    // the directory is full only with an unused chunk on top, which
+    // makes way for the one coming back
+    if (core->populated == core->nr_chunks) {
+        spare = core->chunks[core_dir(core, --core->populated)];
+    }
+
+    core->first = core_dir(core, core->nr_chunks - 1);
+    core->chunks[core->first] = chunk;
+    core->populated++;
+    core->size += CHUNK_INTS;
+    core->spilled--;
+    notify(core, STACK_CORE_UNSPILL, CHUNK_INTS, 0);
+
+out:
+    core_unlock(core);
+    stack_core_free(spare);
+    return ret;
+}
+
+// chunks that hold values or the lowest keep positions,
+// a wrapped ring may hold values in any of them
+static inline unsigned int core_needed(struct stack_core *core, unsigned int keep)
+{
+    if (core->base) {
+        return core->nr_chunks;
+    }
+
+    return DIV_ROUND_UP(max(core->size, keep), CHUNK_INTS);
+}
+
+unsigned int stack_core_trim(struct stack_core *core, unsigned int keep, unsigned int max_chunks)
+{
+    struct stack_core_bounds *bounds;
+    unsigned int freed = 0;
+    int *chunk;
+
+    // one chunk per lock hold, freeing may sleep and pushers keep going
+    while (freed < max_chunks) {
+        core_lock(core);
+        if (core->populated <= core_needed(core, keep)) {
+            core_unlock(core);
+            break;
+        }
+        chunk = core->chunks[core_dir(core, --core->populated)];
+        bounds = core->bounds ? core->bounds[core->populated] : NULL;
+        core_unlock(core);
+
+        stack_core_free(chunk);
+        stack_core_free(bounds);
+        freed++;
+    }
+
+    return freed;
+}
+
+unsigned int stack_core_trimmable(struct stack_core *core, unsigned int keep)
+{
+    unsigned int populated = READ_ONCE(core->populated);
+    unsigned int needed = DIV_ROUND_UP(max(READ_ONCE(core->size), keep), CHUNK_INTS);
+
+    if (READ_ONCE(core->base)) {
+        return 0;
+    }
+
+    return populated > needed ? populated - needed : 0;
+}
+
+void stack_core_hold(struct stack_core *core)
+{
+    core_lock(core);
+}
+
+void stack_core_release(struct stack_core *core)
+{
+    core_unlock(core);
+}
+
+int stack_core_resize(struct stack_core *core, unsigned int new_size)
+{
+    unsigned int nr_chunks;
+    unsigned int old_populated, old_max_size, old_first, old_nr_chunks, rot, end, i;
+    unsigned int evicted = 0;
+    struct stack_core_bounds **bounds = NULL, **old_bounds;
+    int **chunks, **old_chunks;
+    bool need_spare = false;
+    int *spare = NULL;
+
+    // rounding up to whole chunks would wrap above the limit
+    if (new_size > STACK_CORE_MAX_INTS) {
+        return -EINVAL;
+    }
+    nr_chunks = DIV_ROUND_UP(new_size, CHUNK_INTS);
+
+retry:
+    // allocating outside of the lock so pushers and pops keep going
+    chunks = stack_core_calloc(nr_chunks, sizeof(int *), core->node);
+    if (!chunks) {
+        return -ENOMEM;
+    }
+    if (core->bounds) {
+        bounds = stack_core_calloc(nr_chunks, sizeof(*bounds), core->node);
+        if (!bounds) {
+            stack_core_free(chunks);
+            return -ENOMEM;
+        }
+    }
+    if (need_spare) {
+        spare = stack_core_alloc(CHUNK_INTS * sizeof(int), core->node);
+        if (!spare) {
+            stack_core_free(chunks);
+            stack_core_free(bounds);
+            return -ENOMEM;
+        }
+    }
+
+    core_lock(core);
+
+    // a reader drains the stack before loading a spilled chunk back,
+    // which then has to fit on its own
+    if (core->spilled && new_size < CHUNK_INTS) {
+        core_unlock(core);
+        stack_core_free(chunks);
+        stack_core_free(bounds);
+        return -EBUSY;
+    }
+
+    if (core->records) {
+        // dropping whole records from the top, a cut through one would
+        // leave a payload int where the next length is expected
+        while (core->size > new_size) {
+            core->size -= stack_core_record_ints(*core_slot(core, core->size - 1));
+        }
+    } else if (new_size < core->size) {
+        // a ring keeps its newest values and moves the bottom up past the
+        // rest, otherwise the size points at the new last element and the
+        // following ones are dropped with their chunks
+        if (core->drop_oldest) {
+            evicted = core->size - new_size;
+            core->base = core_phys(core, evicted);
+        }
+        core->size = new_size;
+    }
+    if (core->size == 0) {
+        core->base = 0;
+    }
+
+    // the new directory starts with the chunk holding the bottom value,
+    // only the offset of the bottom into it stays in base, a ring that
+    // wrapped ends at end in that layout, past the last chunk, and one
+    // that never wrapped may miss chunks only above its values
+    rot = core->base / CHUNK_INTS;
+    end = core->base % CHUNK_INTS + core->size;
+    old_nr_chunks = core->nr_chunks;
+
+    // growing a ring whose top wrapped into the front of its bottom chunk
+    // gives that top a chunk of its own, allocated without the lock
+    if (end > old_nr_chunks * CHUNK_INTS && nr_chunks > old_nr_chunks && !spare) {
+        core_unlock(core);
+        stack_core_free(chunks);
+        stack_core_free(bounds);
+        bounds = NULL;
+        need_spare = true;
+        goto retry;
+    }
+
+    old_populated = core->populated;
+    old_first = core->first;
+    core->populated = min(core->populated, nr_chunks);
+    for (i = 0; i < core->populated; i++) {
+        chunks[i] = core->chunks[core_dir(core, (rot + i) % old_populated)];
+    }
+
+    // values move only where the top wraps differently in the new ring,
+    // less than a chunk of them
+    if (end > old_nr_chunks * CHUNK_INTS && nr_chunks > old_nr_chunks) {
+        memcpy(spare, chunks[0], (end - old_nr_chunks * CHUNK_INTS) * sizeof(int));
+        chunks[core->populated++] = spare;
+        spare = NULL;
+    } else if (end > nr_chunks * CHUNK_INTS && nr_chunks < old_nr_chunks) {
+        memcpy(chunks[0], core->chunks[core_dir(core, (rot + nr_chunks) % old_populated)],
+               (end - nr_chunks * CHUNK_INTS) * sizeof(int));
+    }
+
+    core->first = 0;
+    core->base %= CHUNK_INTS;
+    if (bounds) {
+        // bounds of the values left only look further down, so they still hold
+        memcpy(bounds, core->bounds, core->populated * sizeof(*bounds));
+    }
+
+    old_bounds = core->bounds;
+    core->bounds = bounds;
+    old_chunks = core->chunks;
+    old_max_size = core->max_size;
+    core->chunks = chunks;
+    core->nr_chunks = nr_chunks;
+    core->max_size = new_size;
+    if (evicted) {
+        notify(core, STACK_CORE_EVICT, evicted, 0);
+    }
+    notify(core, STACK_CORE_RESIZE, old_max_size, 0);
+
+    core_unlock(core);
+
+    // chunks past the new capacity are only referenced by the old directory
+    stack_core_free(spare);
+    for (i = nr_chunks; i < old_populated; i++) {
+        stack_core_free(old_chunks[(old_first + (rot + i) % old_populated) % old_nr_chunks]);
+        if (old_bounds) {
+            stack_core_free(old_bounds[i]);
+        }
+    }
+    stack_core_free(old_chunks);
+    stack_core_free(old_bounds);
+
+    return 0;
+}
+
+// a single accumulator and no early exit, so the loop vectorizes
+// wherever the target and build allow it
+static long long sum_run(const int *v, unsigned int k)
+{
+    long long sum = 0;
+    unsigned int i;
+
+    for (i = 0; i < k; i++) {
+        sum += v[i];
+    }
+
+    return sum;
+}
+
+// branch-free selects, vectorizable like sum_run
+static void bounds_run(const int *v, unsigned int k, int *min, int *max)
+{
+    int lo = *min, hi = *max;
+    unsigned int i;
+
+    for (i = 0; i < k; i++) {
+        lo = v[i] < lo ? v[i] : lo;
+        hi = v[i] > hi ? v[i] : hi;
+    }
+
+    *min = lo;
+    *max = hi;
+}
+
+unsigned int stack_core_reduce(struct stack_core *core, unsigned int skip, unsigned int n,
+                               unsigned int max_scan, bool sum, struct stack_core_reduce *out)
+{
+    struct stack_core_bounds b;
+    bool scan_bounds = true;
+    unsigned int top, left, k;
+    const int *src;
+
+    out->sum = 0;
+    out->min = INT_MAX;
+    out->max = INT_MIN;
+
+    core_lock(core);
+
+    out->size = core_total(core);
+    top = core->size - min(skip, core->size);
+    n = min(n, top);
+    // checked under the lock, the size may have changed since the caller looked
+    if (sum || !core->bounds || n < core->size) {
+        n = min(n, max_scan);
+    }
+
+    // the bounds under the top value cover the whole stack
+    if (core->bounds && n && n == core->size) {
+        b = *core_bounds(core, n - 1);
+        out->min = b.min;
+        out->max = b.max;
+        scan_bounds = false;
+    }
+
+    // run by run downwards, the ring wraps at a chunk boundary
+    for (left = (sum || scan_bounds) ? n : 0; left; left -= k) {
+        k = min(left, core_phys(core, top - 1) % CHUNK_INTS + 1);
+        top -= k;
+        src = core_slot(core, top);
+        if (sum) {
+            out->sum += sum_run(src, k);
+        }
+        if (scan_bounds) {
+            bounds_run(src, k, &out->min, &out->max);
+        }
+    }
+
+    core_unlock(core);
+    return n;
+}
@@ -0,0 +1,215 @@
+#ifndef STACK_CORE_H
+#define STACK_CORE_H
+
+// push/pop/resize engine of int_stack, free of kernel APIs
+// builds against stack_core_kernel.h inside the module and against
+// stack_core_user.h for the userspace library and tests
+
+#ifdef __KERNEL__
+#include "stack_core_kernel.h"
+#else
+#include "stack_core_user.h"
+#endif
+
+// values live in page sized chunks, so growing never moves them
+#define STACK_CORE_CHUNK_INTS ((unsigned int)(STACK_CORE_PAGE_SIZE / sizeof(int)))
+
+// largest max_size, whole chunks of positions that still add up to twice
+// the capacity without overflowing where a drop_oldest ring wraps
+#define STACK_CORE_MAX_INTS (UINT_MAX / 2 / STACK_CORE_CHUNK_INTS * STACK_CORE_CHUNK_INTS)
+
+// slots where a contended push waits for a contended pop to take its value
+#define STACK_CORE_ELIM_SLOTS 8
+
+enum stack_core_event {
+    STACK_CORE_PUSH,        // count values pushed, value is the new top
+                            // for records count is 1 and value the record length
+    STACK_CORE_POP,         // count values popped, value is the first one popped
+                            // for records count is 1 and value the record length
+    STACK_CORE_RESIZE,      // count is the previous max_size
+    STACK_CORE_CONTENDED,   // lock was held by someone else when taking it
+    STACK_CORE_ELIM_HIT,    // single value push or pop met its counterpart, value moved
+    STACK_CORE_ELIM_MISS,   // single value push or pop found no counterpart, took the lock
+    STACK_CORE_SPILL,       // bottom chunk of count values left the stack
+    STACK_CORE_UNSPILL,     // count values came back under the bottom
+    STACK_CORE_EVICT,       // count values dropped from the bottom by a push or a resize
+};
+
+struct stack_core;
+
+// smallest and largest value at or below a position
+struct stack_core_bounds {
+    int min;
+    int max;
+};
+
+// outcome of stack_core_reduce, min and max are INT_MAX and INT_MIN
+// when no value was reduced, sum is 0 unless it was asked for
+struct stack_core_reduce {
+    long long sum;
+    int min;
+    int max;
+    unsigned int size;  // stack size at the moment of the reduce, spilled values included
+};
+
+// called with the core lock held, so it sees size and max_size
+// exactly as the event left them, except for STACK_CORE_ELIM_* events
+// which happen without the lock and never change the stack
+typedef void (*stack_core_hook_t)(struct stack_core *core, enum stack_core_event event,
+                                  unsigned int count, int value);
+
+struct stack_core {
+    int **chunks;               // directory, populated entries from first on are allocated
+    unsigned int nr_chunks;     // directory length, enough to back max_size
+    unsigned int first;         // directory entry of the bottom chunk, moved by spills
+    unsigned int populated;
+    unsigned int size;
+    unsigned int max_size;
+    stack_core_lock_t lock;     // held only while values are moved in or out of chunks
+    stack_core_hook_t hook;     // optional
+    bool records;               // holds records rather than single values
+    int node;                   // memory node for chunks and directory, or STACK_CORE_NO_NODE
+    unsigned int spilled;       // chunks taken from under the bottom by stack_core_spill
+    bool elimination;           // contended single value push/pop pairs bypass the lock
+    bool drop_oldest;           // a push into a full stack evicts from the bottom
+    unsigned int base;          // position holding the bottom value, 0 unless drop_oldest evicted
+    struct stack_core_bounds **bounds;  // parallel to chunks once tracked, NULL otherwise
+    stack_core_atomic64_t elim[STACK_CORE_ELIM_SLOTS];
+};
+
+// node pins all allocations of the core to one memory node, with
+// STACK_CORE_NO_NODE they land wherever the allocating task runs
+// returns 0, -EINVAL for a max_size above STACK_CORE_MAX_INTS or -ENOMEM
+int stack_core_init(struct stack_core *core, unsigned int max_size, stack_core_hook_t hook,
+                    int node);
+
+// a record is stored as its payload padded to whole ints followed by one
+// int holding its length, so the top of the stack is always a length
+// max_size still counts ints, resize drops whole records from the top
+// a core set up this way only takes the *_record calls below
+int stack_core_init_records(struct stack_core *core, unsigned int max_size, stack_core_hook_t hook,
+                            int node);
+void stack_core_destroy(struct stack_core *core);
+
+// pushes up to n values, last one ends up on top
+// returns number of values pushed, -ERANGE if the stack is full
+// or -ENOMEM if no chunk could be allocated for the first value
+int stack_core_push(struct stack_core *core, const int *values, unsigned int n);
+
+// pushes values a pop took back, like stack_core_push but never evicting
+// with drop_oldest, so nothing else on the stack is lost for them
+int stack_core_push_back(struct stack_core *core, const int *values, unsigned int n);
+
+// pops up to n values into out, top of the stack goes first
+// returns number of values popped
+unsigned int stack_core_pop(struct stack_core *core, int *out, unsigned int n);
+
+// copies up to n values from the top into out without popping them
+// returns number of values copied, *size is set to the current size,
+// which counts spilled values too
+unsigned int stack_core_peek(struct stack_core *core, int *out, unsigned int n, unsigned int *size);
+
+// with elimination on, a push of one value that finds the lock held
+// offers the value in a slot for a while, and a pop of one value that
+// finds the lock held takes any offered value, such a pair behaves as a
+// push immediately followed by a pop and leaves the stack untouched
+// meant to be set before the core is shared, records never eliminate
+static inline void stack_core_set_elimination(struct stack_core *core, bool on)
+{
+    core->elimination = on && !core->records;
+}
+
+// with drop_oldest on, a push into a full stack evicts as many values
+// from the bottom as it needs room for instead of failing with -ERANGE,
+// positions then form a ring over the chunks, so eviction only moves
+// base and no value is copied
+// meant to be set before the core is shared, records never drop and
+// such a core never spills
+static inline void stack_core_set_drop_oldest(struct stack_core *core, bool on)
+{
+    core->drop_oldest = on && !core->records && !core->bounds;
+}
+
+// keeps the min and max of all values at or below every position next to
+// the position itself, so both are known for the whole stack in O(1),
+// pushes pay for it with one more write per value and pops not at all
+// to be called on a core that has not been pushed to yet
+// returns 0, -EINVAL for records or drop_oldest cores or -ENOMEM
+int stack_core_track_bounds(struct stack_core *core);
+
+// reduces up to n values lying below the top skip ones and above those
+// spilled, without popping
+// them, summing only when sum is set, the lock is held for a scan of at
+// most max_scan values, unless tracked bounds answer a sum-less reduce
+// of the whole stack, which takes no scan and is not limited
+// returns number of values reduced
+unsigned int stack_core_reduce(struct stack_core *core, unsigned int skip, unsigned int n,
+                               unsigned int max_scan, bool sum, struct stack_core_reduce *out);
+
+// moves the full bottom chunk out of the stack for the caller to keep
+// elsewhere, size drops by STACK_CORE_CHUNK_INTS and spilled grows by one,
+// values above keep their order and the room freed takes new pushes
+// returns the chunk, to be freed with stack_core_free by the caller,
+// or NULL if the bottom chunk is not full, the core drops oldest values
+// or tracks bounds, which hold for the values below
+int *stack_core_spill(struct stack_core *core);
+
+// puts back a chunk returned by the last stack_core_spill, under the
+// values on the stack, the core takes ownership of chunk on success
+// returns 0, or -ERANGE if the stack has no room for a whole chunk
+// spills and unspills only move first, the directory is never shifted
+int stack_core_unspill(struct stack_core *core, int *chunk);
+
+// ints taken by a record of len bytes, length included
+static inline unsigned int stack_core_record_ints(unsigned int len)
+{
+    return DIV_ROUND_UP(len, sizeof(int)) + 1;
+}
+
+// pushes one record of len bytes, all or nothing
+// returns len, -EINVAL for an empty record, -ERANGE if there is no room for it right now,
+// -EMSGSIZE if it could not fit even into an empty stack
+// or -ENOMEM if no chunk could be allocated
+int stack_core_push_record(struct stack_core *core, const void *data, unsigned int len);
+
+// pops the top record into out if it fits into cap bytes
+// returns the record length, nothing is popped if it is above cap,
+// 0 if the stack is empty
+unsigned int stack_core_pop_record(struct stack_core *core, void *out, unsigned int cap);
+
+// frees allocated chunks that are needed neither by the values on the
+// stack nor by the lowest keep positions, at most max_chunks of them
+// capacity is unchanged, freed chunks are allocated again on demand
+// returns number of chunks freed
+unsigned int stack_core_trim(struct stack_core *core, unsigned int keep, unsigned int max_chunks);
+
+// racy count of chunks stack_core_trim would free with the same keep
+unsigned int stack_core_trimmable(struct stack_core *core, unsigned int keep);
+
+// changes capacity, values above new_size are dropped, from the bottom
+// with drop_oldest on, like a push into a full ring drops them
+// -EINVAL for a new_size above STACK_CORE_MAX_INTS, -EBUSY for a
+// capacity below one chunk while chunks are spilled, they could never
+// come back
+// only the chunk directory is reallocated, values are never copied,
+// except less than a chunk of them when a wrapped drop_oldest ring
+// changes the number of chunks it wraps over
+int stack_core_resize(struct stack_core *core, unsigned int new_size);
+
+// takes the core lock for callers keeping state of their own in step
+// with hook events, which are all delivered under it
+void stack_core_hold(struct stack_core *core);
+void stack_core_release(struct stack_core *core);
+
+// racy reads for sizing buffers and wait conditions
+static inline unsigned int stack_core_size(struct stack_core *core)
+{
+    return READ_ONCE(core->size);
+}
+
+static inline unsigned int stack_core_max_size(struct stack_core *core)
+{
+    return READ_ONCE(core->max_size);
+}
+
+#endif
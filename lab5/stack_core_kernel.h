@@ -0,0 +1,41 @@
+#ifndef STACK_CORE_KERNEL_H
+#define STACK_CORE_KERNEL_H
+
+// stack_core primitives inside the module
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/numa.h>
+#include <linux/overflow.h>
+#include <linux/atomic.h>
+#include <linux/smp.h>
+
+#define STACK_CORE_PAGE_SIZE PAGE_SIZE
+
+typedef spinlock_t stack_core_lock_t;
+
+#define stack_core_lock_init(l) spin_lock_init(l)
+#define stack_core_lock_destroy(l) do { } while (0)
+#define stack_core_trylock(l) spin_trylock(l)
+#define stack_core_lock_raw(l) spin_lock(l)
+#define stack_core_unlock(l) spin_unlock(l)
+
+typedef atomic64_t stack_core_atomic64_t;
+
+#define stack_core_atomic64_read(a) atomic64_read(a)
+#define stack_core_atomic64_set(a, v) atomic64_set(a, v)
+#define stack_core_atomic64_cmpxchg(a, old, new) atomic64_cmpxchg(a, old, new)
+#define stack_core_relax() cpu_relax()
+#define stack_core_cpu_hint() raw_smp_processor_id()
+
+#define STACK_CORE_NO_NODE NUMA_NO_NODE
+
+#define stack_core_alloc(size, node) kvmalloc_node(size, GFP_KERNEL, node)
+#define stack_core_calloc(n, size, node) kvzalloc_node(array_size(n, size), GFP_KERNEL, node)
+#define stack_core_free(p) kvfree(p)
+
+#endif
@@ -0,0 +1,390 @@
+// KUnit suite and micro-benchmarks for the int_stack engine
+// runs against stack_core alone, no character device or USB key needed
+
+#include <kunit/test.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+
+// built as its own module, so the engine is compiled in rather than
+// shared with int_stack.ko
+#include "stack_core.c"
+
+static void push_pop_order_test(struct kunit *test)
+{
+    struct stack_core core;
+    int in[] = { 1, 2, 3, 4, 5 };
+    int out[5];
+
+    KUNIT_ASSERT_EQ(test, stack_core_init(&core, 10, NULL, STACK_CORE_NO_NODE), 0);
+
+    KUNIT_EXPECT_EQ(test, stack_core_push(&core, in, 5), 5);
+    KUNIT_EXPECT_EQ(test, stack_core_pop(&core, out, 2), 2U);
+    KUNIT_EXPECT_EQ(test, out[0], 5);
+    KUNIT_EXPECT_EQ(test, out[1], 4);
+    KUNIT_EXPECT_EQ(test, stack_core_pop(&core, out, 5), 3U);
+    KUNIT_EXPECT_EQ(test, out[0], 3);
+    KUNIT_EXPECT_EQ(test, out[2], 1);
+
+    stack_core_destroy(&core);
+}
+
+static void full_and_empty_test(struct kunit *test)
+{
+    struct stack_core core;
+    int in[] = { 1, 2, 3, 4 };
+    int out[4];
+
+    KUNIT_ASSERT_EQ(test, stack_core_init(&core, 3, NULL, STACK_CORE_NO_NODE), 0);
+
+    KUNIT_EXPECT_EQ(test, stack_core_pop(&core, out, 4), 0U);
+    KUNIT_EXPECT_EQ(test, stack_core_push(&core, in, 4), 3);
+    KUNIT_EXPECT_EQ(test, stack_core_push(&core, in, 1), -ERANGE);
+    KUNIT_EXPECT_EQ(test, stack_core_size(&core), 3U);
+
+    stack_core_destroy(&core);
+}
+
+// INT_STACK_SET_SIZE below the current size truncates it
+static void set_size_shrink_test(struct kunit *test)
+{
+    struct stack_core core;
+    int in[] = { 1, 2, 3, 4, 5, 6 };
+    int out[6];
+
+    KUNIT_ASSERT_EQ(test, stack_core_init(&core, 6, NULL, STACK_CORE_NO_NODE), 0);
+    KUNIT_EXPECT_EQ(test, stack_core_push(&core, in, 6), 6);
+
+    KUNIT_EXPECT_EQ(test, stack_core_resize(&core, 4), 0);
+    KUNIT_EXPECT_EQ(test, stack_core_size(&core), 4U);
+    KUNIT_EXPECT_EQ(test, stack_core_max_size(&core), 4U);
+    KUNIT_EXPECT_EQ(test, stack_core_push(&core, in, 1), -ERANGE);
+
+    KUNIT_EXPECT_EQ(test, stack_core_pop(&core, out, 6), 4U);
+    KUNIT_EXPECT_EQ(test, out[0], 4);
+    KUNIT_EXPECT_EQ(test, out[3], 1);
+
+    stack_core_destroy(&core);
+}
+
+static void chunk_boundaries_test(struct kunit *test)
+{
+    unsigned int total = 3 * STACK_CORE_CHUNK_INTS + 5;
+    unsigned int done = 0, i, n;
+    struct stack_core core;
+    int *in, *out;
+    int ret;
+
+    in = kunit_kmalloc_array(test, total, sizeof(int), GFP_KERNEL);
+    out = kunit_kmalloc_array(test, total, sizeof(int), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, in);
+    KUNIT_ASSERT_NOT_NULL(test, out);
+    KUNIT_ASSERT_EQ(test, stack_core_init(&core, total, NULL, STACK_CORE_NO_NODE), 0);
+
+    for (i = 0; i < total; i++) {
+        in[i] = i;
+    }
+
+    while (done < total) {
+        ret = stack_core_push(&core, in + done, min(1000U, total - done));
+        KUNIT_ASSERT_GT(test, ret, 0);
+        done += ret;
+    }
+
+    for (done = 0; done < total; done += n) {
+        n = stack_core_pop(&core, out + done, 777);
+        KUNIT_ASSERT_GT(test, n, 0U);
+    }
+
+    for (i = 0; i < total; i++) {
+        KUNIT_ASSERT_EQ(test, out[i], (int)(total - 1 - i));
+    }
+
+    stack_core_destroy(&core);
+}
+
+static void records_test(struct kunit *test)
+{
+    struct stack_core core;
+    char out[16];
+
+    KUNIT_ASSERT_EQ(test, stack_core_init_records(&core, 8, NULL, STACK_CORE_NO_NODE), 0);
+
+    KUNIT_EXPECT_EQ(test, stack_core_push_record(&core, "hello", 5), 5);
+    KUNIT_EXPECT_EQ(test, stack_core_push_record(&core, "ab", 2), 2);
+    KUNIT_EXPECT_EQ(test, stack_core_push_record(&core, "abcdefghi", 9), -ERANGE);
+
+    KUNIT_EXPECT_EQ(test, stack_core_pop_record(&core, out, 1), 2U);
+    KUNIT_EXPECT_EQ(test, stack_core_pop_record(&core, out, sizeof(out)), 2U);
+    KUNIT_EXPECT_EQ(test, memcmp(out, "ab", 2), 0);
+
+    // shrinking cuts at a record boundary
+    KUNIT_EXPECT_EQ(test, stack_core_resize(&core, 2), 0);
+    KUNIT_EXPECT_EQ(test, stack_core_size(&core), 0U);
+
+    stack_core_destroy(&core);
+}
+
+static void drop_oldest_test(struct kunit *test)
+{
+    struct stack_core core;
+    int in[] = { 1, 2, 3, 4, 5 };
+    int out[3];
+
+    KUNIT_ASSERT_EQ(test, stack_core_init(&core, 3, NULL, STACK_CORE_NO_NODE), 0);
+    stack_core_set_drop_oldest(&core, true);
+
+    // the two oldest values make room instead of the push failing
+    KUNIT_EXPECT_EQ(test, stack_core_push(&core, in, 5), 5);
+    KUNIT_EXPECT_EQ(test, stack_core_size(&core), 3U);
+    KUNIT_EXPECT_EQ(test, stack_core_pop(&core, out, 3), 3U);
+    KUNIT_EXPECT_EQ(test, out[0], 5);
+    KUNIT_EXPECT_EQ(test, out[2], 3);
+
+    stack_core_destroy(&core);
+}
+
+static void reduce_test(struct kunit *test)
+{
+    struct stack_core core;
+    struct stack_core_reduce r;
+    int in[] = { 4, -2, 9, 1 };
+    int out[1];
+
+    KUNIT_ASSERT_EQ(test, stack_core_init(&core, 10, NULL, STACK_CORE_NO_NODE), 0);
+    KUNIT_ASSERT_EQ(test, stack_core_track_bounds(&core), 0);
+    KUNIT_EXPECT_EQ(test, stack_core_push(&core, in, 4), 4);
+
+    // whole stack min and max come from the bounds under the top
+    KUNIT_EXPECT_EQ(test, stack_core_reduce(&core, 0, UINT_MAX, 1, false, &r), 4U);
+    KUNIT_EXPECT_EQ(test, r.min, -2);
+    KUNIT_EXPECT_EQ(test, r.max, 9);
+    // anything else scans, at most max_scan values
+    KUNIT_EXPECT_EQ(test, stack_core_reduce(&core, 0, 3, 1, false, &r), 1U);
+
+    KUNIT_EXPECT_EQ(test, stack_core_reduce(&core, 1, 2, UINT_MAX, true, &r), 2U);
+    KUNIT_EXPECT_EQ(test, r.sum, 7LL);
+    KUNIT_EXPECT_EQ(test, r.min, -2);
+
+    // popping the max uncovers the bounds below it
+    KUNIT_EXPECT_EQ(test, stack_core_pop(&core, out, 1), 1U);
+    KUNIT_EXPECT_EQ(test, stack_core_pop(&core, out, 1), 1U);
+    KUNIT_EXPECT_EQ(test, stack_core_reduce(&core, 0, UINT_MAX, UINT_MAX, false, &r), 2U);
+    KUNIT_EXPECT_EQ(test, r.max, 4);
+
+    stack_core_destroy(&core);
+}
+
+static void trim_test(struct kunit *test)
+{
+    unsigned int total = 4 * STACK_CORE_CHUNK_INTS;
+    struct stack_core core;
+    int *values;
+
+    values = kunit_kcalloc(test, total, sizeof(int), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, values);
+    KUNIT_ASSERT_EQ(test, stack_core_init(&core, total, NULL, STACK_CORE_NO_NODE), 0);
+
+    KUNIT_EXPECT_EQ(test, stack_core_push(&core, values, total), (int)total);
+    KUNIT_EXPECT_EQ(test, stack_core_pop(&core, values, total - 1), total - 1);
+
+    // the floor keeps a second chunk, the value left keeps the first
+    KUNIT_EXPECT_EQ(test, stack_core_trimmable(&core, STACK_CORE_CHUNK_INTS + 1), 2U);
+    KUNIT_EXPECT_EQ(test, stack_core_trim(&core, STACK_CORE_CHUNK_INTS + 1, 1), 1U);
+    KUNIT_EXPECT_EQ(test, stack_core_trim(&core, 0, UINT_MAX), 2U);
+    KUNIT_EXPECT_EQ(test, stack_core_max_size(&core), total);
+
+    stack_core_destroy(&core);
+}
+
+struct worker {
+    struct stack_core *core;
+    struct completion done;
+    unsigned int id;
+    unsigned int ops;
+    bool producer;
+    const bool *stop;   // set when the run is abandoned
+    s64 sum;
+};
+
+// producers push ops distinct values, consumers pop ops values
+static int worker_fn(void *arg)
+{
+    struct worker *w = arg;
+    unsigned int moved = 0;
+    int value;
+
+    while (moved < w->ops && !READ_ONCE(*w->stop)) {
+        if (w->producer) {
+            value = w->id * w->ops + moved;
+            if (stack_core_push(w->core, &value, 1) == 1) {
+                w->sum += value;
+                moved++;
+            }
+        } else if (stack_core_pop(w->core, &value, 1) == 1) {
+            w->sum += value;
+            moved++;
+        }
+        cond_resched();
+    }
+
+    complete(&w->done);
+    return 0;
+}
+
+// runs threads producer/consumer pairs, returns elapsed ns or 0 on failure
+static u64 run_workers(struct kunit *test, struct stack_core *core, unsigned int threads,
+                       unsigned int ops, s64 *pushed, s64 *popped)
+{
+    struct worker *workers;
+    struct task_struct *task;
+    bool stop = false;
+    unsigned int i;
+    u64 start;
+
+    workers = kunit_kcalloc(test, 2 * threads, sizeof(*workers), GFP_KERNEL);
+    if (!workers) {
+        return 0;
+    }
+
+    start = ktime_get_ns();
+    for (i = 0; i < 2 * threads; i++) {
+        workers[i].core = core;
+        workers[i].id = i / 2;
+        workers[i].ops = ops;
+        workers[i].producer = !(i % 2);
+        workers[i].stop = &stop;
+        init_completion(&workers[i].done);
+
+        task = kthread_run(worker_fn, &workers[i], "int_stack_kunit/%u", i);
+        if (IS_ERR(task)) {
+            // the threads already running use workers and core, which
+            // must outlive them, and may lack a partner to finish
+            WRITE_ONCE(stop, true);
+            while (i--) {
+                wait_for_completion(&workers[i].done);
+            }
+            return 0;
+        }
+    }
+
+    *pushed = *popped = 0;
+    for (i = 0; i < 2 * threads; i++) {
+        wait_for_completion(&workers[i].done);
+        if (workers[i].producer) {
+            *pushed += workers[i].sum;
+        } else {
+            *popped += workers[i].sum;
+        }
+    }
+
+    return ktime_get_ns() - start;
+}
+
+static const bool elimination_params[] = { false, true };
+
+static void elimination_desc(const bool *param, char *desc)
+{
+    snprintf(desc, KUNIT_PARAM_DESC_SIZE, "elimination %s", *param ? "on" : "off");
+}
+KUNIT_ARRAY_PARAM(elimination, elimination_params, elimination_desc);
+
+static void concurrent_access_test(struct kunit *test)
+{
+    bool elimination = *(const bool *)test->param_value;
+    struct stack_core core;
+    s64 pushed, popped;
+
+    KUNIT_ASSERT_EQ(test, stack_core_init(&core, 512, NULL, STACK_CORE_NO_NODE), 0);
+    stack_core_set_elimination(&core, elimination);
+
+    KUNIT_ASSERT_GT(test, run_workers(test, &core, 4, 20000, &pushed, &popped), 0ULL);
+    KUNIT_EXPECT_EQ(test, pushed, popped);
+    KUNIT_EXPECT_EQ(test, stack_core_size(&core), 0U);
+
+    stack_core_destroy(&core);
+}
+
+#define BENCH_PAIRS 100000
+
+// single thread push/pop pairs at several fill levels
+static void push_pop_bench(struct kunit *test)
+{
+    static const unsigned int sizes[] = { 16, 4096, 1 << 20 };
+    struct stack_core core;
+    unsigned int i, j;
+    int value = 1;
+    u64 start, ns;
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        KUNIT_ASSERT_EQ(test, stack_core_init(&core, sizes[i], NULL, STACK_CORE_NO_NODE), 0);
+
+        // half filled so pairs run in the middle of the stack
+        for (j = 0; j < sizes[i] / 2; j++) {
+            stack_core_push(&core, &value, 1);
+        }
+
+        start = ktime_get_ns();
+        for (j = 0; j < BENCH_PAIRS; j++) {
+            stack_core_push(&core, &value, 1);
+            stack_core_pop(&core, &value, 1);
+        }
+        ns = ktime_get_ns() - start;
+
+        kunit_info(test, "size %u: %u pairs in %llu ns, %llu ns/pair\n",
+                   sizes[i], BENCH_PAIRS, ns, div_u64(ns, BENCH_PAIRS));
+
+        stack_core_destroy(&core);
+    }
+}
+
+// producer/consumer pairs at several thread counts
+static void threads_bench(struct kunit *test)
+{
+    static const unsigned int threads[] = { 1, 2, 4 };
+    struct stack_core core;
+    s64 pushed, popped;
+    unsigned int i;
+    u64 ns;
+
+    for (i = 0; i < ARRAY_SIZE(threads); i++) {
+        KUNIT_ASSERT_EQ(test, stack_core_init(&core, 4096, NULL, STACK_CORE_NO_NODE), 0);
+
+        ns = run_workers(test, &core, threads[i], BENCH_PAIRS / threads[i], &pushed, &popped);
+        KUNIT_ASSERT_GT(test, ns, 0ULL);
+        KUNIT_EXPECT_EQ(test, pushed, popped);
+
+        kunit_info(test, "%u thread pair(s): %llu ns, %llu ops/s\n",
+                   threads[i], ns, div64_u64(2ULL * BENCH_PAIRS * NSEC_PER_SEC, ns));
+
+        stack_core_destroy(&core);
+    }
+}
+
+static struct kunit_case int_stack_test_cases[] = {
+    KUNIT_CASE(push_pop_order_test),
+    KUNIT_CASE(full_and_empty_test),
+    KUNIT_CASE(set_size_shrink_test),
+    KUNIT_CASE(chunk_boundaries_test),
+    KUNIT_CASE(records_test),
+    KUNIT_CASE(drop_oldest_test),
+    KUNIT_CASE(reduce_test),
+    KUNIT_CASE(trim_test),
+    KUNIT_CASE_PARAM_ATTR(concurrent_access_test, elimination_gen_params,
+                          { .speed = KUNIT_SPEED_SLOW }),
+    KUNIT_CASE_SLOW(push_pop_bench),
+    KUNIT_CASE_SLOW(threads_bench),
+    {}
+};
+
+static struct kunit_suite int_stack_test_suite = {
+    .name = "int_stack",
+    .test_cases = int_stack_test_cases,
+};
+kunit_test_suite(int_stack_test_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Artyom Shaposhnikov");
+MODULE_DESCRIPTION("KUnit tests for the int_stack engine");
@@ -0,0 +1,697 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "stack_core.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, __func__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static unsigned int hook_pushed, hook_popped, hook_resizes, hook_evicted;
+
+static void count_events(struct stack_core *core, enum stack_core_event event,
+                         unsigned int count, int value) {
+    (void)core;
+    (void)value;
+
+    switch (event) {
+    case STACK_CORE_PUSH:
+        hook_pushed += count;
+        break;
+    case STACK_CORE_POP:
+        hook_popped += count;
+        break;
+    case STACK_CORE_RESIZE:
+        hook_resizes++;
+        break;
+    case STACK_CORE_EVICT:
+        hook_evicted += count;
+        break;
+    case STACK_CORE_CONTENDED:
+    case STACK_CORE_ELIM_HIT:
+    case STACK_CORE_ELIM_MISS:
+    case STACK_CORE_SPILL:
+    case STACK_CORE_UNSPILL:
+        break;
+    }
+}
+
+static void test_lifo_order(void) {
+    struct stack_core core;
+    int in[] = { 1, 2, 3, 4, 5 };
+    int out[5];
+
+    CHECK(stack_core_init(&core, 10, NULL, STACK_CORE_NO_NODE) == 0);
+
+    CHECK(stack_core_push(&core, in, 5) == 5);
+    CHECK(stack_core_size(&core) == 5);
+
+    CHECK(stack_core_pop(&core, out, 2) == 2);
+    CHECK(out[0] == 5 && out[1] == 4);
+
+    CHECK(stack_core_pop(&core, out, 5) == 3);
+    CHECK(out[0] == 3 && out[1] == 2 && out[2] == 1);
+
+    stack_core_destroy(&core);
+}
+
+static void test_full_and_empty(void) {
+    struct stack_core core;
+    int in[] = { 1, 2, 3, 4 };
+    int out[4];
+
+    CHECK(stack_core_init(&core, 3, NULL, STACK_CORE_NO_NODE) == 0);
+
+    CHECK(stack_core_pop(&core, out, 4) == 0);
+
+    // only what fits is pushed, then the stack reports full
+    CHECK(stack_core_push(&core, in, 4) == 3);
+    CHECK(stack_core_push(&core, in, 1) == -ERANGE);
+    CHECK(stack_core_size(&core) == 3);
+
+    CHECK(stack_core_pop(&core, out, 4) == 3);
+    CHECK(out[0] == 3);
+    CHECK(stack_core_pop(&core, out, 1) == 0);
+
+    stack_core_destroy(&core);
+}
+
+static void test_resize(void) {
+    struct stack_core core;
+    int in[] = { 1, 2, 3, 4, 5, 6 };
+    int out[6];
+
+    CHECK(stack_core_init(&core, 6, NULL, STACK_CORE_NO_NODE) == 0);
+    CHECK(stack_core_push(&core, in, 6) == 6);
+
+    // shrinking below size drops the top values
+    CHECK(stack_core_resize(&core, 4) == 0);
+    CHECK(stack_core_size(&core) == 4);
+    CHECK(stack_core_max_size(&core) == 4);
+    CHECK(stack_core_push(&core, in, 1) == -ERANGE);
+
+    // growing keeps what is there
+    CHECK(stack_core_resize(&core, 100000) == 0);
+    CHECK(stack_core_size(&core) == 4);
+    CHECK(stack_core_push(&core, in + 5, 1) == 1);
+    CHECK(stack_core_pop(&core, out, 6) == 5);
+    CHECK(out[0] == 6 && out[1] == 4 && out[4] == 1);
+
+    // capacities that do not round up to whole chunks are refused
+    CHECK(stack_core_resize(&core, UINT_MAX) == -EINVAL);
+    CHECK(stack_core_max_size(&core) == 100000);
+    CHECK(stack_core_push(&core, in, 6) == 6);
+    CHECK(stack_core_pop(&core, out, 6) == 6);
+    CHECK(out[0] == 6 && out[5] == 1);
+
+    stack_core_destroy(&core);
+    CHECK(stack_core_init(&core, UINT_MAX, NULL, STACK_CORE_NO_NODE) == -EINVAL);
+}
+
+static void test_chunk_boundaries(void) {
+    unsigned int total = 3 * STACK_CORE_CHUNK_INTS + 5;
+    struct stack_core core;
+    int *in = malloc(sizeof(int) * total);
+    int *out = malloc(sizeof(int) * total);
+    unsigned int done = 0, i;
+    int ret;
+
+    CHECK(in && out);
+    CHECK(stack_core_init(&core, total, NULL, STACK_CORE_NO_NODE) == 0);
+
+    for (i = 0; i < total; i++) {
+        in[i] = (int)i;
+    }
+
+    // odd batch sizes make pushes and pops straddle chunk edges
+    while (done < total) {
+        ret = stack_core_push(&core, in + done, min(1000u, total - done));
+        CHECK(ret > 0);
+        if (ret <= 0) {
+            break;
+        }
+        done += ret;
+    }
+    CHECK(stack_core_size(&core) == total);
+    CHECK(stack_core_push(&core, in, 1) == -ERANGE);
+
+    done = 0;
+    while (done < total) {
+        unsigned int n = stack_core_pop(&core, out + done, 777);
+        CHECK(n > 0);
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+
+    for (i = 0; i < total; i++) {
+        if (out[i] != (int)(total - 1 - i)) {
+            CHECK(out[i] == (int)(total - 1 - i));
+            break;
+        }
+    }
+
+    stack_core_destroy(&core);
+    free(in);
+    free(out);
+}
+
+static void test_peek(void) {
+    struct stack_core core;
+    int in[] = { 7, 8, 9 };
+    int out[3];
+    unsigned int size = 0;
+
+    CHECK(stack_core_init(&core, 10, NULL, STACK_CORE_NO_NODE) == 0);
+    CHECK(stack_core_push(&core, in, 3) == 3);
+
+    CHECK(stack_core_peek(&core, out, 2, &size) == 2);
+    CHECK(out[0] == 9 && out[1] == 8);
+    CHECK(size == 3);
+    CHECK(stack_core_size(&core) == 3);
+
+    stack_core_destroy(&core);
+}
+
+static void test_records(void) {
+    struct stack_core core;
+    char big[3 * STACK_CORE_PAGE_SIZE];
+    char out[3 * STACK_CORE_PAGE_SIZE];
+
+    // 3 + 2 ints for "hello", 2 + 1 for "abcdefg", the big one spans chunks
+    CHECK(stack_core_init_records(&core, 3 * STACK_CORE_CHUNK_INTS + 16, NULL,
+                                  STACK_CORE_NO_NODE) == 0);
+
+    memset(big, 'x', sizeof(big) - 1);
+    CHECK(stack_core_push_record(&core, "hello", 6) == 6);
+    CHECK(stack_core_push_record(&core, big, sizeof(big) - 1) == (int)sizeof(big) - 1);
+    CHECK(stack_core_push_record(&core, "abcdefg", 7) == 7);
+    CHECK(stack_core_size(&core) == 3 + stack_core_record_ints(sizeof(big) - 1) + 3);
+
+    // a record too big for the buffer reports its length and stays
+    CHECK(stack_core_pop_record(&core, out, 4) == 7);
+    CHECK(stack_core_pop_record(&core, out, sizeof(out)) == 7);
+    CHECK(memcmp(out, "abcdefg", 7) == 0);
+
+    CHECK(stack_core_push_record(&core, big, sizeof(big)) == -ERANGE);
+    CHECK(stack_core_push_record(&core, big, 0) == -EINVAL);
+
+    // shrinking drops the big record as a whole
+    CHECK(stack_core_resize(&core, 10) == 0);
+    CHECK(stack_core_size(&core) == 3);
+    CHECK(stack_core_push_record(&core, big, 64) == -EMSGSIZE);
+
+    CHECK(stack_core_pop_record(&core, out, sizeof(out)) == 6);
+    CHECK(strcmp(out, "hello") == 0);
+    CHECK(stack_core_pop_record(&core, out, sizeof(out)) == 0);
+
+    stack_core_destroy(&core);
+}
+
+static void test_trim(void) {
+    unsigned int total = 4 * STACK_CORE_CHUNK_INTS;
+    struct stack_core core;
+    int *values = calloc(total, sizeof(int));
+    int out[1];
+
+    CHECK(values != NULL);
+    CHECK(stack_core_init(&core, total, NULL, STACK_CORE_NO_NODE) == 0);
+
+    // every chunk is allocated once the stack has been full
+    CHECK(stack_core_push(&core, values, total) == (int)total);
+    CHECK(stack_core_pop(&core, values, total - 1) == total - 1);
+    CHECK(stack_core_trimmable(&core, 0) == 3);
+
+    // keep holds chunks beyond what the single value needs
+    CHECK(stack_core_trim(&core, STACK_CORE_CHUNK_INTS + 1, 10) == 2);
+    CHECK(stack_core_trim(&core, 0, 10) == 1);
+    CHECK(stack_core_trim(&core, 0, 10) == 0);
+
+    // capacity stays, trimmed chunks come back on demand
+    CHECK(stack_core_max_size(&core) == total);
+    CHECK(stack_core_push(&core, values, total - 1) == (int)total - 1);
+    CHECK(stack_core_size(&core) == total);
+    CHECK(stack_core_pop(&core, out, 1) == 1);
+
+    stack_core_destroy(&core);
+    free(values);
+}
+
+static void test_drop_oldest(void) {
+    // not a multiple of the chunk size, so the ring wraps inside the last chunk
+    unsigned int max = 2 * STACK_CORE_CHUNK_INTS + 5, total = 3 * STACK_CORE_CHUNK_INTS;
+    struct stack_core core;
+    int *values = malloc(sizeof(int) * total);
+    int *out = malloc(sizeof(int) * total);
+
+    CHECK(values && out);
+    CHECK(stack_core_init(&core, max, count_events, STACK_CORE_NO_NODE) == 0);
+    stack_core_set_drop_oldest(&core, true);
+    hook_evicted = 0;
+
+    for (unsigned int i = 0; i < total; i++) {
+        values[i] = (int)i;
+    }
+
+    // single pushes past max_size evict one value each
+    for (unsigned int i = 0; i < max + 3; i++) {
+        CHECK(stack_core_push(&core, values + i, 1) == 1);
+    }
+    CHECK(stack_core_size(&core) == max);
+    CHECK(hook_evicted == 3);
+    CHECK(core.base == 3);
+
+    // values a read failed to deliver never evict others to get back
+    CHECK(stack_core_push_back(&core, values, 1) == -ERANGE);
+    CHECK(hook_evicted == 3);
+
+    // a wrapped ring holds on to all of its chunks
+    CHECK(stack_core_trimmable(&core, 0) == 0);
+
+    // a batch longer than the stack keeps only its own newest values
+    CHECK(stack_core_push(&core, values, total) == (int)total);
+    CHECK(hook_evicted == 3 + total);
+    CHECK(stack_core_pop(&core, out, total) == max);
+    for (unsigned int i = 0; i < max; i++) {
+        if (out[i] != (int)(total - 1 - i)) {
+            CHECK(out[i] == (int)(total - 1 - i));
+            break;
+        }
+    }
+    CHECK(core.base == 0);
+
+    // shrinking a wrapped ring evicts from the bottom and keeps the newest
+    // values in order
+    hook_evicted = 0;
+    CHECK(stack_core_push(&core, values, max + 10) == (int)max + 10);
+    CHECK(stack_core_resize(&core, STACK_CORE_CHUNK_INTS) == 0);
+    CHECK(hook_evicted == 10 + max - STACK_CORE_CHUNK_INTS);
+    CHECK(core.base == 15);
+    CHECK(stack_core_pop(&core, out, total) == STACK_CORE_CHUNK_INTS);
+    for (unsigned int i = 0; i < STACK_CORE_CHUNK_INTS; i++) {
+        if (out[i] != (int)(max + 9 - i)) {
+            CHECK(out[i] == (int)(max + 9 - i));
+            break;
+        }
+    }
+
+    // growing a ring whose top wrapped into its bottom chunk
+    CHECK(stack_core_resize(&core, max) == 0);
+    CHECK(stack_core_push(&core, values, total) == (int)total);
+    CHECK(stack_core_push(&core, values, 3) == 3);
+    CHECK(core.base == STACK_CORE_CHUNK_INTS - 2);
+    CHECK(stack_core_resize(&core, total + STACK_CORE_CHUNK_INTS) == 0);
+    CHECK(stack_core_size(&core) == max);
+    CHECK(stack_core_pop(&core, out, total) == max);
+    CHECK(out[0] == 2 && out[2] == 0 && out[3] == (int)total - 1);
+    for (unsigned int i = 3; i < max; i++) {
+        if (out[i] != (int)(total + 2 - i)) {
+            CHECK(out[i] == (int)(total + 2 - i));
+            break;
+        }
+    }
+
+    // and so does shrinking one that never filled all of its chunks
+    CHECK(stack_core_push(&core, values, max - 2) == (int)max - 2);
+    CHECK(stack_core_resize(&core, STACK_CORE_CHUNK_INTS + 1) == 0);
+    CHECK(core.populated == 2);
+    CHECK(stack_core_pop(&core, out, total) == STACK_CORE_CHUNK_INTS + 1);
+    CHECK(out[0] == (int)max - 3 && out[STACK_CORE_CHUNK_INTS] == (int)(max - 3 - STACK_CORE_CHUNK_INTS));
+
+    // a spilling core could not find its bottom chunk in a ring
+    CHECK(stack_core_push(&core, values, total) == (int)total);
+    CHECK(stack_core_spill(&core) == NULL);
+
+    stack_core_destroy(&core);
+    free(values);
+    free(out);
+}
+
+// brute force over the top n values below skip, in push order in values
+static void check_reduce(struct stack_core *core, const int *values, unsigned int size,
+                         unsigned int skip, unsigned int n, bool sum) {
+    struct stack_core_reduce r;
+    long long want_sum = 0;
+    int want_min = INT_MAX, want_max = INT_MIN;
+    unsigned int got;
+
+    n = skip < size ? (n < size - skip ? n : size - skip) : 0;
+    for (unsigned int i = size - skip - n; i < size - skip; i++) {
+        want_sum += values[i];
+        want_min = values[i] < want_min ? values[i] : want_min;
+        want_max = values[i] > want_max ? values[i] : want_max;
+    }
+
+    got = stack_core_reduce(core, skip, n, UINT_MAX, sum, &r);
+    CHECK(got == n);
+    CHECK(r.size == size);
+    CHECK(r.sum == (sum ? want_sum : 0));
+    CHECK(r.min == want_min && r.max == want_max);
+}
+
+static void test_reduce(void) {
+    unsigned int total = 3 * STACK_CORE_CHUNK_INTS + 7;
+    struct stack_core core;
+    int *values = malloc(sizeof(int) * total);
+    struct stack_core_reduce r;
+    int out[1];
+    unsigned int seed = 12345;
+
+    CHECK(values != NULL);
+    CHECK(stack_core_init(&core, total, NULL, STACK_CORE_NO_NODE) == 0);
+    CHECK(stack_core_track_bounds(&core) == 0);
+
+    // bounds sit under values pushed in batches crossing chunks and one by one
+    for (unsigned int i = 0; i < total; i++) {
+        seed = seed * 1103515245u + 12345u;
+        values[i] = (int)seed;
+    }
+    CHECK(stack_core_push(&core, values, total - 5) == (int)total - 5);
+    for (unsigned int i = total - 5; i < total; i++) {
+        CHECK(stack_core_push(&core, values + i, 1) == 1);
+    }
+
+    check_reduce(&core, values, total, 0, total, false);
+    check_reduce(&core, values, total, 0, UINT_MAX, true);
+    check_reduce(&core, values, total, 0, STACK_CORE_CHUNK_INTS + 3, true);
+    check_reduce(&core, values, total, 9, 2 * STACK_CORE_CHUNK_INTS, true);
+    check_reduce(&core, values, total, total, 10, true);
+
+    // only the bounds of the whole stack go past the scan limit
+    CHECK(stack_core_reduce(&core, 0, UINT_MAX, 10, false, &r) == total);
+    CHECK(stack_core_reduce(&core, 0, total - 1, 10, false, &r) == 10);
+    CHECK(stack_core_reduce(&core, 0, UINT_MAX, 10, true, &r) == 10);
+    CHECK(stack_core_reduce(&core, 1, UINT_MAX, 10, false, &r) == 10);
+
+    // popping and shrinking leave the bounds of the values below as they were
+    CHECK(stack_core_pop(&core, out, 1) == 1);
+    check_reduce(&core, values, total - 1, 0, total, false);
+    CHECK(stack_core_resize(&core, STACK_CORE_CHUNK_INTS + 1) == 0);
+    check_reduce(&core, values, STACK_CORE_CHUNK_INTS + 1, 0, total, false);
+    CHECK(stack_core_spill(&core) == NULL);
+
+    // an untracked ring reduces by scanning across its wrap
+    stack_core_destroy(&core);
+    CHECK(stack_core_init(&core, STACK_CORE_CHUNK_INTS + 5, NULL, STACK_CORE_NO_NODE) == 0);
+    stack_core_set_drop_oldest(&core, true);
+    CHECK(stack_core_track_bounds(&core) == -EINVAL);
+    CHECK(stack_core_push(&core, values, total) == (int)total);
+    check_reduce(&core, values + total - (STACK_CORE_CHUNK_INTS + 5), STACK_CORE_CHUNK_INTS + 5,
+                 2, STACK_CORE_CHUNK_INTS, true);
+
+    stack_core_destroy(&core);
+    free(values);
+}
+
+static void test_spill(void) {
+    unsigned int total = 3 * STACK_CORE_CHUNK_INTS;
+    struct stack_core core;
+    int *values = malloc(sizeof(int) * total);
+    int *out = malloc(sizeof(int) * total);
+    struct stack_core_reduce r;
+    unsigned int size;
+    int *spilled[2];
+
+    CHECK(values && out);
+    CHECK(stack_core_init(&core, 2 * STACK_CORE_CHUNK_INTS, NULL, STACK_CORE_NO_NODE) == 0);
+
+    for (unsigned int i = 0; i < total; i++) {
+        values[i] = (int)i;
+    }
+
+    // a partly filled bottom chunk stays
+    CHECK(stack_core_push(&core, values, 10) == 10);
+    CHECK(stack_core_spill(&core) == NULL);
+
+    // spilling makes room for pushes past max_size
+    CHECK(stack_core_push(&core, values + 10, 2 * STACK_CORE_CHUNK_INTS - 10) ==
+          (int)(2 * STACK_CORE_CHUNK_INTS - 10));
+    spilled[0] = stack_core_spill(&core);
+    CHECK(spilled[0] != NULL && spilled[0][0] == 0);
+    CHECK(core.spilled == 1);
+    CHECK(stack_core_size(&core) == STACK_CORE_CHUNK_INTS);
+
+    // peek and reduce see only the values in memory, but count the spilled ones
+    CHECK(stack_core_peek(&core, out, total, &size) == STACK_CORE_CHUNK_INTS);
+    CHECK(size == 2 * STACK_CORE_CHUNK_INTS);
+    CHECK(stack_core_reduce(&core, 0, UINT_MAX, UINT_MAX, true, &r) == STACK_CORE_CHUNK_INTS);
+    CHECK(r.size == 2 * STACK_CORE_CHUNK_INTS);
+    CHECK(r.min == (int)STACK_CORE_CHUNK_INTS);
+
+    // a spilled chunk could never come back into a stack smaller than it
+    CHECK(stack_core_resize(&core, 10) == -EBUSY);
+    CHECK(stack_core_push(&core, values + 2 * STACK_CORE_CHUNK_INTS, STACK_CORE_CHUNK_INTS) ==
+          (int)STACK_CORE_CHUNK_INTS);
+    spilled[1] = stack_core_spill(&core);
+    CHECK(spilled[1] != NULL && spilled[1][0] == (int)STACK_CORE_CHUNK_INTS);
+
+    // the directory wrapped around by now, resizing lays it out from 0 again
+    CHECK(stack_core_resize(&core, 3 * STACK_CORE_CHUNK_INTS) == 0);
+    CHECK(core.first == 0);
+    CHECK(stack_core_resize(&core, 2 * STACK_CORE_CHUNK_INTS) == 0);
+
+    // no room to take a chunk back while the stack holds one and a bit
+    CHECK(stack_core_push(&core, values, 1) == 1);
+    CHECK(stack_core_unspill(&core, spilled[1]) == -ERANGE);
+    CHECK(stack_core_pop(&core, out, 1) == 1);
+
+    // draining with chunks coming back in reverse order gives every value in LIFO order
+    CHECK(stack_core_pop(&core, out, total) == STACK_CORE_CHUNK_INTS);
+    CHECK(stack_core_unspill(&core, spilled[1]) == 0);
+    CHECK(stack_core_pop(&core, out + STACK_CORE_CHUNK_INTS, total) == STACK_CORE_CHUNK_INTS);
+    CHECK(stack_core_unspill(&core, spilled[0]) == 0);
+    CHECK(stack_core_pop(&core, out + 2 * STACK_CORE_CHUNK_INTS, total) == STACK_CORE_CHUNK_INTS);
+    CHECK(core.spilled == 0);
+
+    for (unsigned int i = 0; i < total; i++) {
+        if (out[i] != (int)(total - 1 - i)) {
+            CHECK(out[i] == (int)(total - 1 - i));
+            break;
+        }
+    }
+
+    stack_core_destroy(&core);
+    free(values);
+    free(out);
+}
+
+static void test_hook(void) {
+    struct stack_core core;
+    int in[] = { 1, 2, 3 };
+    int out[3];
+
+    hook_pushed = hook_popped = hook_resizes = 0;
+
+    CHECK(stack_core_init(&core, 10, count_events, STACK_CORE_NO_NODE) == 0);
+    CHECK(stack_core_push(&core, in, 3) == 3);
+    CHECK(stack_core_pop(&core, out, 2) == 2);
+    CHECK(stack_core_resize(&core, 20) == 0);
+
+    CHECK(hook_pushed == 3);
+    CHECK(hook_popped == 2);
+    CHECK(hook_resizes == 1);
+
+    stack_core_destroy(&core);
+}
+
+#define WORKERS 4
+#define VALUES_PER_WORKER 200000
+
+struct worker {
+    struct stack_core *core;
+    int id;
+    long long sum;
+};
+
+static void *producer(void *arg) {
+    struct worker *w = arg;
+    int batch[16];
+    int next = 0;
+
+    while (next < VALUES_PER_WORKER) {
+        int n = 0;
+
+        while (n < 16 && next + n < VALUES_PER_WORKER) {
+            batch[n] = w->id * VALUES_PER_WORKER + next + n;
+            n++;
+        }
+
+        int ret = stack_core_push(w->core, batch, n);
+        if (ret > 0) {
+            for (int i = 0; i < ret; i++) {
+                w->sum += batch[i];
+            }
+            next += ret;
+        }
+    }
+
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    struct worker *w = arg;
+    int batch[16];
+    int got = 0;
+
+    while (got < VALUES_PER_WORKER) {
+        unsigned int n = stack_core_pop(w->core, batch, min(16, VALUES_PER_WORKER - got));
+
+        for (unsigned int i = 0; i < n; i++) {
+            w->sum += batch[i];
+        }
+        got += n;
+    }
+
+    return NULL;
+}
+
+// every value pushed is popped exactly once under contention
+static void test_concurrent(void) {
+    struct stack_core core;
+    struct worker prod[WORKERS], cons[WORKERS];
+    pthread_t threads[2 * WORKERS];
+    long long pushed = 0, popped = 0;
+
+    CHECK(stack_core_init(&core, 5000, NULL, STACK_CORE_NO_NODE) == 0);
+
+    for (int i = 0; i < WORKERS; i++) {
+        prod[i] = (struct worker){ .core = &core, .id = i };
+        cons[i] = (struct worker){ .core = &core, .id = i };
+        pthread_create(&threads[i], NULL, producer, &prod[i]);
+        pthread_create(&threads[WORKERS + i], NULL, consumer, &cons[i]);
+    }
+
+    for (int i = 0; i < 2 * WORKERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < WORKERS; i++) {
+        pushed += prod[i].sum;
+        popped += cons[i].sum;
+    }
+
+    CHECK(pushed == popped);
+    CHECK(stack_core_size(&core) == 0);
+
+    stack_core_destroy(&core);
+}
+
+// one lock round trip per value, so fewer of them
+#define SINGLE_VALUES_PER_WORKER 1000
+
+static long long elim_hits, elim_misses;
+
+static void count_elim(struct stack_core *core, enum stack_core_event event,
+                       unsigned int count, int value) {
+    (void)core;
+    (void)count;
+    (void)value;
+
+    if (event == STACK_CORE_ELIM_HIT) {
+        __atomic_add_fetch(&elim_hits, 1, __ATOMIC_RELAXED);
+    } else if (event == STACK_CORE_ELIM_MISS) {
+        __atomic_add_fetch(&elim_misses, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void *single_producer(void *arg) {
+    struct worker *w = arg;
+    int next = 0;
+
+    while (next < SINGLE_VALUES_PER_WORKER) {
+        int value = w->id * SINGLE_VALUES_PER_WORKER + next;
+
+        if (stack_core_push(w->core, &value, 1) == 1) {
+            w->sum += value;
+            next++;
+        }
+    }
+
+    return NULL;
+}
+
+static void *single_consumer(void *arg) {
+    struct worker *w = arg;
+    int got = 0;
+
+    while (got < SINGLE_VALUES_PER_WORKER) {
+        int value;
+
+        if (stack_core_pop(w->core, &value, 1) == 1) {
+            w->sum += value;
+            got++;
+        }
+    }
+
+    return NULL;
+}
+
+// eliminated pairs lose and duplicate nothing either
+static void test_elimination(void) {
+    struct stack_core core;
+    struct worker prod[WORKERS], cons[WORKERS];
+    pthread_t threads[2 * WORKERS];
+    long long pushed = 0, popped = 0;
+
+    elim_hits = elim_misses = 0;
+
+    CHECK(stack_core_init(&core, 64, count_elim, STACK_CORE_NO_NODE) == 0);
+    stack_core_set_elimination(&core, true);
+
+    for (int i = 0; i < WORKERS; i++) {
+        prod[i] = (struct worker){ .core = &core, .id = i };
+        cons[i] = (struct worker){ .core = &core, .id = i };
+        pthread_create(&threads[i], NULL, single_producer, &prod[i]);
+        pthread_create(&threads[WORKERS + i], NULL, single_consumer, &cons[i]);
+    }
+
+    for (int i = 0; i < 2 * WORKERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < WORKERS; i++) {
+        pushed += prod[i].sum;
+        popped += cons[i].sum;
+    }
+
+    CHECK(pushed == popped);
+    CHECK(stack_core_size(&core) == 0);
+    // hits come in pairs, one for the push and one for the pop
+    CHECK(elim_hits % 2 == 0);
+
+    printf("stack_core: elimination %lld hits, %lld misses\n", elim_hits, elim_misses);
+    stack_core_destroy(&core);
+}
+
+int main(void) {
+    test_lifo_order();
+    test_full_and_empty();
+    test_resize();
+    test_chunk_boundaries();
+    test_peek();
+    test_records();
+    test_trim();
+    test_drop_oldest();
+    test_reduce();
+    test_spill();
+    test_hook();
+    test_concurrent();
+    test_elimination();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("stack_core: all tests passed\n");
+    return 0;
+}
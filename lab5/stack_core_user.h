@@ -0,0 +1,65 @@
+#ifndef STACK_CORE_USER_H
+#define STACK_CORE_USER_H
+
+// stack_core primitives for the userspace library and tests
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define STACK_CORE_PAGE_SIZE 4096UL
+
+// userspace threads can be preempted inside the critical section,
+// so a mutex stands in for the kernel spinlock
+typedef pthread_mutex_t stack_core_lock_t;
+
+#define stack_core_lock_init(l) pthread_mutex_init(l, NULL)
+#define stack_core_lock_destroy(l) pthread_mutex_destroy(l)
+#define stack_core_trylock(l) (pthread_mutex_trylock(l) == 0)
+#define stack_core_lock_raw(l) pthread_mutex_lock(l)
+#define stack_core_unlock(l) pthread_mutex_unlock(l)
+
+typedef long long stack_core_atomic64_t;
+
+#define stack_core_atomic64_read(a) __atomic_load_n(a, __ATOMIC_SEQ_CST)
+#define stack_core_atomic64_set(a, v) __atomic_store_n(a, v, __ATOMIC_SEQ_CST)
+#define stack_core_relax() sched_yield()
+// threads rather than CPUs pick elimination slots
+#define stack_core_cpu_hint() ((unsigned int)((unsigned long)pthread_self() >> 12))
+
+// returns the value found, like the kernel's atomic64_cmpxchg
+static inline long long stack_core_atomic64_cmpxchg(stack_core_atomic64_t *a, long long old,
+                                                     long long new)
+{
+    __atomic_compare_exchange_n(a, &old, new, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return old;
+}
+
+// placement is left to the process memory policy, e.g. numactl
+#define STACK_CORE_NO_NODE (-1)
+
+#define stack_core_alloc(size, node) ((void)(node), malloc(size))
+#define stack_core_calloc(n, size, node) ((void)(node), calloc(n, size))
+#define stack_core_free(p) free(p)
+
+#ifndef READ_ONCE
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *)&(x))
+#endif
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#ifndef DIV_ROUND_UP
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#endif
+
+#endif